@@ -17,30 +17,131 @@
  * audio signals, and sends them back.
  */
 
+#include <algorithm>
 #include <memory>
 #include <vector>
 
 #include "dsp.h"
+#include "stats.h"
 #include "am_decoder.h"
 
 using namespace std;
 
 namespace radioreceiver {
 
-AMDecoder::AMDecoder(int inRate, int outRate, int bandwidth)
-    : demodulator_(inRate, kInterRate, bandwidth / 2, 351),
-      filterCoefs_(getLowPassFIRCoeffs(kInterRate, kFilterFreq, kFilterLen)),
-      downSampler_(kInterRate, outRate, filterCoefs_) {}
+// The stopband attenuation and passband ripple of the filters, in dB.
+const float kAttenuation = 70;
+const float kRipple = 0.1;
+// How far the channel filter's passband ends below its cutoff and its
+// stopband starts above it, in Hz.
+const float kChannelPassBelow = 5000;
+const float kChannelStopAbove = 7000;
+
+/**
+ * Designs the channel filter of the front end.
+ * @param inRate The sample rate of the input.
+ * @param cutoff The frequency the transition band is placed around.
+ * @return The filter's coefficients.
+ */
+static vector<float> channelFilter(int inRate, float cutoff) {
+  float passFreq = max<float>(0, cutoff - kChannelPassBelow);
+  return getEquirippleFIRCoeffs(inRate, passFreq, cutoff + kChannelStopAbove,
+                                kAttenuation, kRipple);
+}
+
+AMDecoder::AMDecoder(int inRate, int outRate, int bandwidth, int channelRate)
+    : inRate_(inRate),
+      channelRate_(channelRate),
+      minimumPhase_(false),
+      pipeline_(FrontEnd(inRate, channelRate,
+                         channelFilter(inRate, bandwidth / 2)),
+                AMDetector(),
+                Downsampler(channelRate, outRate,
+                            getEquirippleFIRCoeffs(channelRate, kFilterPass,
+                                                   kFilterStop, kAttenuation,
+                                                   kRipple)),
+                NoPostFilter()) {}
 
 StereoAudio AMDecoder::decode(const Samples& samples, bool inStereo) {
-  Samples demodulated(demodulator_.demodulateTuned(samples));
+  FrontEnd& frontEnd = pipeline_.frontEnd();
+  SamplesIQ channel(frontEnd.process(samples));
+  return decodeChannel(channel, frontEnd.squelched(), inStereo);
+}
+
+FrontEnd* AMDecoder::frontEnd() {
+  return &pipeline_.frontEnd();
+}
 
+StereoAudio AMDecoder::decodeChannel(const SamplesIQ& channel,
+                                     bool squelched, bool inStereo) {
   StereoAudio output;
   output.inStereo = false;
-  output.left = downSampler_.downsample(demodulated);
+  output.left = pipeline_.process(channel, squelched);
   output.right = output.left;
-  output.carrier = demodulator_.hasCarrier();
+  output.carrier = pipeline_.discriminator().hasCarrier();
+  if (squelched) {
+    for (int i = 0; i < extraSamplers_.size(); ++i) {
+      extraOutputs_[i].left = extraSamplers_[i]->silence(channel.I.size());
+    }
+  } else if (!extraSamplers_.empty()) {
+    Samples demodulated(pipeline_.demodulated(),
+                        pipeline_.demodulated()
+                        + pipeline_.demodulatedLength());
+    StageTimer timer(STAGE_RESAMPLER, demodulated.size());
+    for (int i = 0; i < extraSamplers_.size(); ++i) {
+      extraOutputs_[i].left = extraSamplers_[i]->downsample(demodulated);
+    }
+  }
+  for (StereoAudio& extra : extraOutputs_) {
+    extra.right = extra.left;
+    extra.carrier = output.carrier;
+  }
   return output;
 }
 
+double AMDecoder::groupDelay() {
+  return pipeline_.frontEnd().delay() / inRate_
+      + pipeline_.resampler().delay() / channelRate_;
+}
+
+void AMDecoder::setSquelch(float level, float hysteresis) {
+  pipeline_.frontEnd().setSquelch(level, hysteresis);
+}
+
+void AMDecoder::setMinimumPhase() {
+  if (minimumPhase_) {
+    return;
+  }
+  minimumPhase_ = true;
+  pipeline_.frontEnd().makeMinimumPhase();
+  pipeline_.resampler().makeMinimumPhase();
+  for (auto& sampler : extraSamplers_) {
+    sampler->makeMinimumPhase();
+  }
+}
+
+bool AMDecoder::squelched() {
+  return pipeline_.squelched();
+}
+
+int AMDecoder::addOutput(int outRate) {
+  // Keeps the passband below the new rate's Nyquist frequency, and the
+  // aliases of the transition band out of the passband.
+  float passFreq = min<float>(kFilterPass, 0.3 * outRate);
+  float stopFreq = min<float>(kFilterStop, outRate - passFreq);
+  extraSamplers_.emplace_back(new Downsampler(
+      channelRate_, outRate,
+      getEquirippleFIRCoeffs(channelRate_, passFreq, stopFreq, kAttenuation,
+                             kRipple)));
+  if (minimumPhase_) {
+    extraSamplers_.back()->makeMinimumPhase();
+  }
+  extraOutputs_.push_back(StereoAudio{Samples(), Samples(), false, false});
+  return extraSamplers_.size() - 1;
+}
+
+StereoAudio AMDecoder::extraOutput(int index) {
+  return extraOutputs_[index];
+}
+
 }  // namespace radioreceiver
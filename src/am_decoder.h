@@ -26,6 +26,7 @@
 
 #include "decoder.h"
 #include "dsp.h"
+#include "pipeline.h"
 
 using namespace std;
 
@@ -36,12 +37,15 @@ namespace radioreceiver {
  */
 class AMDecoder : public Decoder {
   static const int kInterRate = 336000;
-  static const int kFilterFreq = 10000;
-  static const int kFilterLen = 41;
+  static const int kFilterPass = 1000;
+  static const int kFilterStop = 30000;
 
-  AMDemodulator demodulator_;
-  vector<float> filterCoefs_;
-  Downsampler downSampler_;
+  int inRate_;
+  int channelRate_;
+  bool minimumPhase_;
+  Pipeline<FrontEnd, AMDetector, Downsampler, NoPostFilter> pipeline_;
+  vector<unique_ptr<Downsampler> > extraSamplers_;
+  vector<StereoAudio> extraOutputs_;
  public:
   /**
    * Constructor for the decoder.
@@ -49,8 +53,11 @@ class AMDecoder : public Decoder {
    * @param outRate The sample rate for the output stereo audio stream.
    *     The recommended rate is 48000.
    * @param maxF The bandwidth of the input signal.
+   * @param channelRate The sample rate of the channel after the front
+   *     end, when it is shared with other decoders.
    */
-  AMDecoder(int inRate, int outRate, int bandwidth);
+  AMDecoder(int inRate, int outRate, int bandwidth,
+            int channelRate = kInterRate);
 
   /**
    * Demodulates a block of floating-point samples, producing a block of
@@ -60,6 +67,23 @@ class AMDecoder : public Decoder {
    * @return The generated stereo audio block.
    */
   virtual StereoAudio decode(const Samples& samples, bool inStereo);
+
+  virtual FrontEnd* frontEnd();
+
+  virtual StereoAudio decodeChannel(const SamplesIQ& channel, bool squelched,
+                                    bool inStereo);
+
+  virtual double groupDelay();
+
+  virtual void setSquelch(float level, float hysteresis);
+
+  virtual void setMinimumPhase();
+
+  virtual bool squelched();
+
+  virtual int addOutput(int outRate);
+
+  virtual StereoAudio extraOutput(int index);
 };
 
 }  // namespace radioreceiver
@@ -0,0 +1,107 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * Quality measurements on demodulated signals.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <stdint.h>
+#include <vector>
+
+#include "analysis.h"
+
+using namespace std;
+
+namespace radioreceiver {
+
+const double kPi = 3.141592653589793238;
+const double k2Pi = 2 * kPi;
+
+float toneAmplitude(const Samples& samples, int begin, int length,
+                    int sampleRate, float freq) {
+  double re = 0;
+  double im = 0;
+  for (int i = 0; i < length; ++i) {
+    double angle = k2Pi * freq * i / sampleRate;
+    re += samples[begin + i] * cos(angle);
+    im += samples[begin + i] * sin(angle);
+  }
+  return 2 * sqrt(re * re + im * im) / length;
+}
+
+ToneMeasurement measureTone(const Samples& samples, int skip, int sampleRate,
+                            float freq) {
+  int period = sampleRate / 100;
+  int length = (((int) samples.size() - skip) / period) * period;
+  if (length <= 0) {
+    return ToneMeasurement{0, 0, 0};
+  }
+  double mean = 0;
+  for (int i = 0; i < length; ++i) {
+    mean += samples[skip + i];
+  }
+  mean /= length;
+  double total = 0;
+  for (int i = 0; i < length; ++i) {
+    double val = samples[skip + i] - mean;
+    total += val * val;
+  }
+  total /= length;
+
+  float ampl = toneAmplitude(samples, skip, length, sampleRate, freq);
+  double tonePower = ampl * ampl / 2;
+  double harmPower = 0;
+  for (int h = 2; h <= 5 && h * freq < sampleRate / 2; ++h) {
+    float hAmpl = toneAmplitude(samples, skip, length, sampleRate, h * freq);
+    harmPower += hAmpl * hAmpl / 2;
+  }
+  double noisePower = max(total - tonePower - harmPower, 1e-20);
+  return ToneMeasurement{
+      ampl,
+      (float) (10 * log10(tonePower / noisePower)),
+      (float) (10 * log10(max(harmPower, 1e-20) / max(tonePower, 1e-20)))};
+}
+
+int countPrbsErrors(const vector<uint8_t>& bits) {
+  int checks = 0;
+  int errors = 0;
+  for (int i = 15; i < bits.size(); ++i) {
+    ++checks;
+    if (bits[i] != (bits[i - 14] ^ bits[i - 15])) {
+      ++errors;
+    }
+  }
+  return min(errors, checks - errors) / 3;
+}
+
+float prbsBitErrorRate(const Samples& samples, int skip, int sampleRate,
+                       int baudRate) {
+  double spb = (double) sampleRate / baudRate;
+  int steps = max(1, (int) spb);
+  float best = 1;
+  for (int p = 0; p < steps; ++p) {
+    vector<uint8_t> bits;
+    for (double pos = skip + p + spb / 2; pos < samples.size(); pos += spb) {
+      bits.push_back(samples[(int) pos] > 0 ? 1 : 0);
+    }
+    if (bits.size() > 15) {
+      best = min(best, (float) countPrbsErrors(bits) / bits.size());
+    }
+  }
+  return best;
+}
+
+}  // namespace radioreceiver
@@ -0,0 +1,93 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * Quality measurements on demodulated signals.
+ */
+
+#ifndef ANALYSIS_H_
+#define ANALYSIS_H_
+
+#include <stdint.h>
+#include <vector>
+
+#include "dsp.h"
+
+using namespace std;
+
+namespace radioreceiver {
+
+/**
+ * The result of measuring a tone in an audio signal.
+ */
+struct ToneMeasurement {
+  /** The tone's peak amplitude. */
+  float amplitude;
+  /** The ratio of the tone's power to the noise power, in dB. */
+  float snr;
+  /** The ratio of the power of the 2nd to 5th harmonics to the tone's, in dB. */
+  float thd;
+};
+
+/**
+ * Returns the amplitude of the given frequency in a range of samples.
+ * The range should hold a whole number of cycles of the frequency.
+ * @param samples The signal to analyze.
+ * @param begin The index of the first sample to analyze.
+ * @param length The number of samples to analyze.
+ * @param sampleRate The signal's sample rate.
+ * @param freq The frequency to measure.
+ * @return The peak amplitude of the frequency component.
+ */
+float toneAmplitude(const Samples& samples, int begin, int length,
+                    int sampleRate, float freq);
+
+/**
+ * Measures a tone in a signal. Everything but the tone, its harmonics and
+ * the signal's DC component is counted as noise.
+ * @param samples The signal to analyze.
+ * @param skip The number of initial samples to ignore.
+ * @param sampleRate The signal's sample rate.
+ * @param freq The tone's frequency. The analyzed range is trimmed to a
+ *     whole number of 10 ms periods, so it should be a multiple of 100 Hz.
+ * @return The tone's amplitude, signal to noise ratio and distortion.
+ */
+ToneMeasurement measureTone(const Samples& samples, int skip, int sampleRate,
+                            float freq);
+
+/**
+ * Slices an FSK signal carrying a PRBS-15 (x^15 + x^14 + 1) sequence and
+ * returns its bit error rate. The symbol phase and polarity that give the
+ * fewest errors are used.
+ * @param samples The demodulated FSK signal.
+ * @param skip The number of initial samples to ignore.
+ * @param sampleRate The signal's sample rate.
+ * @param baudRate The signal's symbol rate.
+ * @return The bit error rate.
+ */
+float prbsBitErrorRate(const Samples& samples, int skip, int sampleRate,
+                       int baudRate);
+
+/**
+ * Counts the bits that don't follow a PRBS-15 (x^15 + x^14 + 1) sequence.
+ * As each wrong bit breaks three checks, the count is divided by three.
+ * @param bits The bits to check, one per byte.
+ * @return The estimated number of bit errors, for either polarity of the
+ *     bits, whichever is lower.
+ */
+int countPrbsErrors(const vector<uint8_t>& bits);
+
+}  // namespace radioreceiver
+
+#endif  // ANALYSIS_H_
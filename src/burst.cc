@@ -0,0 +1,170 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * Gating of the output audio to the segments in which there is a carrier.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <ostream>
+#include <stdint.h>
+#include <string>
+#include <time.h>
+#include <vector>
+
+#include "burst.h"
+
+using namespace std;
+
+namespace radioreceiver {
+
+void RawBurstWriter::write(const char* data, int length) {
+  out_.write(data, length);
+}
+
+FramedBurstWriter::FramedBurstWriter(ostream& out)
+    : out_(out), burst_(0), first_(false), timeNanos_(0) {}
+
+void FramedBurstWriter::writeHeader(uint32_t flags, uint32_t length) {
+  char header[24] = { 'D', 'M', 'B', 'F' };
+  uint64_t fields[] = { burst_, flags, length };
+  for (int f = 0; f < 3; ++f) {
+    for (int b = 0; b < 4; ++b) {
+      header[4 + 4 * f + b] = (fields[f] >> (8 * b)) & 0xff;
+    }
+  }
+  for (int b = 0; b < 8; ++b) {
+    header[16 + b] = ((uint64_t) timeNanos_ >> (8 * b)) & 0xff;
+  }
+  out_.write(header, sizeof(header));
+}
+
+void FramedBurstWriter::begin(int64_t timeNanos) {
+  ++burst_;
+  first_ = true;
+  timeNanos_ = timeNanos;
+}
+
+void FramedBurstWriter::write(const char* data, int length) {
+  if (length == 0) {
+    return;
+  }
+  writeHeader(first_ ? 1 : 0, length);
+  out_.write(data, length);
+  first_ = false;
+}
+
+void FramedBurstWriter::end() {
+  writeHeader(first_ ? 3 : 2, 0);
+  out_.flush();
+}
+
+FileBurstWriter::FileBurstWriter(const string& dir) : dir_(dir), file_(0) {}
+
+FileBurstWriter::~FileBurstWriter() {
+  end();
+}
+
+void FileBurstWriter::begin(int64_t timeNanos) {
+  end();
+  time_t seconds = timeNanos / 1000000000;
+  struct tm utc;
+  gmtime_r(&seconds, &utc);
+  char name[64];
+  int len = strftime(name, sizeof(name), "burst-%Y%m%d-%H%M%S", &utc);
+  snprintf(name + len, sizeof(name) - len, ".%03d.raw",
+           (int) (timeNanos / 1000000 % 1000));
+  string path = dir_ + "/" + name;
+  file_ = fopen(path.c_str(), "wb");
+  if (!file_) {
+    cerr << "Could not create burst file: " << path << ": " << strerror(errno)
+         << endl;
+  }
+}
+
+void FileBurstWriter::write(const char* data, int length) {
+  if (file_) {
+    fwrite(data, 1, length, file_);
+  }
+}
+
+void FileBurstWriter::end() {
+  if (file_) {
+    fclose(file_);
+    file_ = 0;
+  }
+}
+
+BurstGate::BurstGate(BurstSink* sink, int frameSize, int rate, int preFrames,
+                     int postFrames)
+    : sink_(sink), frameSize_(frameSize), rate_(rate), preFrames_(preFrames),
+      postFrames_(postFrames), frame_(0), active_(false), postLeft_(0) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  origin_ = (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void BurstGate::remember(const char* data, int length) {
+  history_.insert(history_.end(), data, data + length);
+  int excess = history_.size() - preFrames_ * frameSize_;
+  if (excess > 0) {
+    history_.erase(history_.begin(), history_.begin() + excess);
+  }
+}
+
+int BurstGate::process(const char* data, int length, bool carrier) {
+  int frames = length / frameSize_;
+  int written = 0;
+  if (carrier) {
+    if (!active_) {
+      // The history always ends where this block starts.
+      int64_t start = frame_ - history_.size() / frameSize_;
+      active_ = true;
+      sink_->begin(origin_ + start * 1000000000 / rate_);
+      sink_->write(history_.data(), history_.size());
+      written += history_.size() / frameSize_;
+      history_.clear();
+    }
+    sink_->write(data, length);
+    written += frames;
+    postLeft_ = postFrames_;
+  } else if (active_) {
+    int tail = min(frames, postLeft_);
+    sink_->write(data, tail * frameSize_);
+    written += tail;
+    postLeft_ -= tail;
+    if (postLeft_ == 0) {
+      sink_->end();
+      active_ = false;
+      remember(data + tail * frameSize_, length - tail * frameSize_);
+    }
+  } else {
+    remember(data, length);
+  }
+  frame_ += frames;
+  return written;
+}
+
+void BurstGate::flush() {
+  if (active_) {
+    sink_->end();
+    active_ = false;
+  }
+}
+
+}  // namespace radioreceiver
@@ -0,0 +1,173 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * Gating of the output audio to the segments in which there is a carrier.
+ */
+
+#ifndef BURST_H_
+#define BURST_H_
+
+#include <cstdio>
+#include <ostream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace radioreceiver {
+
+/**
+ * Receives the audio of the bursts let through by a BurstGate.
+ */
+class BurstSink {
+ public:
+  virtual ~BurstSink() {}
+
+  /**
+   * Starts a burst.
+   * @param timeNanos The time of the burst's first frame, in nanoseconds
+   *     since the Unix epoch.
+   */
+  virtual void begin(int64_t timeNanos) = 0;
+
+  /**
+   * Adds audio to the current burst.
+   * @param data The packed audio frames.
+   * @param length The length of the data in bytes.
+   */
+  virtual void write(const char* data, int length) = 0;
+
+  /**
+   * Ends the current burst.
+   */
+  virtual void end() = 0;
+};
+
+/**
+ * Writes the bursts back to back, without any separation.
+ */
+class RawBurstWriter : public BurstSink {
+  ostream& out_;
+
+ public:
+  RawBurstWriter(ostream& out) : out_(out) {}
+
+  virtual void begin(int64_t timeNanos) {}
+  virtual void write(const char* data, int length);
+  virtual void end() { out_.flush(); }
+};
+
+/**
+ * Writes each piece of a burst after a 24-byte little-endian header: the
+ * magic "DMBF", the burst number (uint32), flags (uint32; 1 for the
+ * burst's first piece, 2 for its last), the length of the audio that
+ * follows in bytes (uint32) and the burst's start time in nanoseconds
+ * since the Unix epoch (int64). The last piece may be empty.
+ */
+class FramedBurstWriter : public BurstSink {
+  ostream& out_;
+  uint32_t burst_;
+  bool first_;
+  int64_t timeNanos_;
+
+  void writeHeader(uint32_t flags, uint32_t length);
+
+ public:
+  FramedBurstWriter(ostream& out);
+
+  virtual void begin(int64_t timeNanos);
+  virtual void write(const char* data, int length);
+  virtual void end();
+};
+
+/**
+ * Writes each burst to its own file, named after the burst's start time
+ * in UTC.
+ */
+class FileBurstWriter : public BurstSink {
+  string dir_;
+  FILE* file_;
+
+ public:
+  /**
+   * Constructor for the writer.
+   * @param dir The directory to create the files in.
+   */
+  FileBurstWriter(const string& dir);
+  ~FileBurstWriter();
+
+  virtual void begin(int64_t timeNanos);
+  virtual void write(const char* data, int length);
+  virtual void end();
+};
+
+/**
+ * Lets through only the audio blocks in which there is a carrier, plus
+ * some padding before and after, so that the downstream decoders only
+ * work on the parts of the signal that may contain something.
+ */
+class BurstGate {
+  BurstSink* sink_;
+  int frameSize_;
+  int rate_;
+  int preFrames_;
+  int postFrames_;
+  int64_t origin_;
+  int64_t frame_;
+  bool active_;
+  int postLeft_;
+  vector<char> history_;
+
+  void remember(const char* data, int length);
+
+ public:
+  /**
+   * Constructor for the gate.
+   * @param sink The sink for the bursts.
+   * @param frameSize The size of an audio frame in bytes.
+   * @param rate The audio sample rate.
+   * @param preFrames The number of frames to include before the carrier
+   *     appears.
+   * @param postFrames The number of frames to include after the carrier
+   *     disappears.
+   */
+  BurstGate(BurstSink* sink, int frameSize, int rate, int preFrames,
+            int postFrames);
+
+  /**
+   * Processes a block of audio.
+   * @param data The packed audio frames.
+   * @param length The length of the data in bytes.
+   * @param carrier Whether there was a carrier in the block.
+   * @return The number of frames written to the sink, including any
+   *     remembered from before the carrier appeared.
+   */
+  int process(const char* data, int length, bool carrier);
+
+  /**
+   * Ends the current burst, if any.
+   */
+  void flush();
+
+  /**
+   * Tells whether a burst is being let through.
+   */
+  bool active() const { return active_; }
+};
+
+}  // namespace radioreceiver
+
+#endif  // BURST_H_
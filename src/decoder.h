@@ -44,6 +44,74 @@ class Decoder {
    * @return The generated stereo audio block.
    */
   virtual StereoAudio decode(const Samples& samples, bool inStereo) = 0;
+
+  /**
+   * Returns the front end that filters the channel out of the input, so
+   * that other decoders can be fed from it with decodeChannel().
+   * @return The front end, or 0 if the decoder can't share it.
+   */
+  virtual FrontEnd* frontEnd() { return 0; }
+
+  /**
+   * Decodes a block of a channel that has already gone through a front end
+   * shared with other decoders, at the channel rate the decoder was
+   * created for. decode() is the front end followed by this.
+   * @param channel The channel's I/Q samples.
+   * @param squelched Whether the front end's squelch silenced the block.
+   * @param inStereo Whether to try decoding a stereo signal.
+   * @return The generated stereo audio block.
+   */
+  virtual StereoAudio decodeChannel(const SamplesIQ& channel, bool squelched,
+                                    bool inStereo) {
+    return StereoAudio();
+  }
+
+  /**
+   * Returns the combined group delay of the decoder's filters, which is
+   * the latency the decoder adds regardless of block size and speed.
+   * @return The delay in seconds.
+   */
+  virtual double groupDelay() { return 0; }
+
+  /**
+   * Enables a squelch that skips demodulating and filtering the blocks in
+   * which the channel's power is below a threshold, decoding them as
+   * silence instead.
+   * @param level The threshold in dB relative to a full-scale carrier.
+   * @param hysteresis How far below the threshold the power must fall for
+   *     the squelch to close, in dB.
+   */
+  virtual void setSquelch(float level, float hysteresis) {}
+
+  /**
+   * Replaces the decoder's filters, including those of the outputs added
+   * later, with minimum-phase filters with the same magnitude response,
+   * trading a flat group delay for a much shorter one.
+   */
+  virtual void setMinimumPhase() {}
+
+  /**
+   * Tells whether the squelch silenced the last decoded block.
+   */
+  virtual bool squelched() { return false; }
+
+  /**
+   * Adds an output at another sample rate, fed from the same demodulated
+   * signal as the main output so that the front-end filter and the
+   * demodulator only run once for all the outputs.
+   * @param outRate The sample rate for the output.
+   * @return The index of the output for extraOutput(), or -1 if the
+   *     decoder only supports its main output.
+   */
+  virtual int addOutput(int outRate) { return -1; }
+
+  /**
+   * Returns the audio produced for an output added with addOutput() by the
+   * last call to decode().
+   * @param index The output's index.
+   * @return The output's audio block.
+   */
+  virtual StereoAudio extraOutput(int index) { return StereoAudio(); }
 };
 
 }  // namespace radioreceiver
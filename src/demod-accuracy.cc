@@ -0,0 +1,552 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * Checks the decoders' output quality on synthetic signals. Every decoder
+ * variant is run on the same inputs as the reference decoders; each metric
+ * must pass an absolute limit and, for variants other than the reference,
+ * must not be significantly worse than the reference's. With the default
+ * duration and SNR, the reference's figures must also stay close to the
+ * golden ones recorded below. Exits with a non-zero status if any check
+ * fails.
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "analysis.h"
+#include "doppler.h"
+#include "dsp.h"
+#include "am_decoder.h"
+#include "flowgraph.h"
+#include "fsk_decoder.h"
+#include "hdlc.h"
+#include "nbfm_decoder.h"
+#include "siggen.h"
+#include "wbfm_decoder.h"
+
+using namespace radioreceiver;
+using namespace std;
+
+const int kInRate = 1024000;
+const int kOutRate = 48000;
+const int kBlockSize = 65536;
+
+enum {
+  CASE_AM = 0,
+  CASE_NBFM = 1,
+  CASE_WBFM_MONO = 2,
+  CASE_WBFM_STEREO = 3,
+  CASE_FSK = 4,
+  CASE_G3RUH = 5,
+  CASE_AX25 = 6,
+  CASE_NBFM_FREQCORR = 7,
+  CASE_NBFM_IQCORRECT = 8,
+  CASE_AX25_DOPPLER = 9
+};
+
+const char* kCases[] = { "AM", "NBFM", "WBFM-mono", "WBFM-stereo", "FSK9600",
+                         "G3RUH9600", "AX25-9600", "NBFM-freqcorr",
+                         "NBFM-iqcorrect", "AX25-doppler", 0 };
+
+// The tuning error corrected by the NCO in the NBFM-freqcorr and
+// NBFM-iqcorrect cases, in Hz. It is not a multiple of the tone frequency,
+// so none of the FM sidebands sits at 0 Hz, where the IQCorrector couldn't
+// tell it apart from the tuner's DC offset.
+const float kFreqError = 3300;
+
+// The Doppler shift at the start of the AX25-doppler case, in Hz, and its
+// rate of change in Hz per second: a fast pass over the test's duration.
+const float kDopplerStart = 4500;
+const float kDopplerRate = -3000;
+
+// The default duration of the signals in seconds, and their SNR in dB.
+const double kDefaultSeconds = 3;
+const float kDefaultSnr = 40;
+
+/**
+ * A figure the reference decoders measured at the default duration and
+ * SNR, and how much worse they may do.
+ */
+struct Golden {
+  const char* testCase;
+  const char* metric;
+  float value;
+  float tolerance;
+};
+
+// Recorded, rather than measured on every run like the reference, so that
+// a change to the reference decoders can't move the baseline unnoticed.
+// The bit error rates and frame losses are already held at zero by their
+// limits.
+const Golden kGolden[] = {
+  { "AM", "snr_db", 53.98, 2 },
+  { "AM", "thd_db", -90.59, 3 },
+  { "NBFM", "snr_db", 56.29, 2 },
+  { "NBFM", "thd_db", -27.23, 2 },
+  { "WBFM-mono", "snr_db", 48.98, 2 },
+  { "WBFM-mono", "thd_db", -62.17, 3 },
+  { "WBFM-stereo", "separation_left_db", 19.09, 1 },
+  { "WBFM-stereo", "separation_right_db", 19.17, 1 },
+  { "NBFM-freqcorr", "snr_db", 56.09, 2 },
+  { "NBFM-freqcorr", "thd_db", -27.22, 2 },
+  { "NBFM-iqcorrect", "snr_db", 55.94, 2 },
+  { "NBFM-iqcorrect", "thd_db", -27.22, 2 },
+  { 0, 0, 0, 0 }
+};
+
+/**
+ * A way of building the decoders whose output is checked.
+ */
+struct Variant {
+  const char* name;
+  /** The size in bytes of the input blocks fed to the decoders. */
+  int blockSize;
+  Decoder* (*makeAM)(int inRate, int outRate, int bandwidth);
+  Decoder* (*makeNBFM)(int inRate, int outRate, int maxF);
+  Decoder* (*makeWBFM)(int inRate, int outRate);
+  Decoder* (*makeFSK)(int inRate, int baudRate, int maxF);
+};
+
+Decoder* makeReferenceAM(int inRate, int outRate, int bandwidth) {
+  return new AMDecoder(inRate, outRate, bandwidth);
+}
+
+Decoder* makeReferenceNBFM(int inRate, int outRate, int maxF) {
+  return new NBFMDecoder(inRate, outRate, maxF);
+}
+
+Decoder* makeReferenceWBFM(int inRate, int outRate) {
+  return new WBFMDecoder(inRate, outRate);
+}
+
+Decoder* makeReferenceFSK(int inRate, int baudRate, int maxF) {
+  FSKDecoder* decoder = new FSKDecoder(inRate, baudRate, maxF);
+  decoder->setDescramble(true);
+  return decoder;
+}
+
+Decoder* makeMinPhaseAM(int inRate, int outRate, int bandwidth) {
+  Decoder* decoder = makeReferenceAM(inRate, outRate, bandwidth);
+  decoder->setMinimumPhase();
+  return decoder;
+}
+
+Decoder* makeMinPhaseNBFM(int inRate, int outRate, int maxF) {
+  Decoder* decoder = makeReferenceNBFM(inRate, outRate, maxF);
+  decoder->setMinimumPhase();
+  return decoder;
+}
+
+Decoder* makeMinPhaseWBFM(int inRate, int outRate) {
+  Decoder* decoder = makeReferenceWBFM(inRate, outRate);
+  decoder->setMinimumPhase();
+  return decoder;
+}
+
+Decoder* makeMinPhaseFSK(int inRate, int baudRate, int maxF) {
+  Decoder* decoder = makeReferenceFSK(inRate, baudRate, maxF);
+  decoder->setMinimumPhase();
+  return decoder;
+}
+
+/**
+ * Builds a flowgraph decoder, exiting if the description is invalid.
+ */
+Decoder* makeGraph(int inRate, int outRate, const string& description) {
+  Flowgraph* graph = new Flowgraph(inRate, outRate);
+  if (!graph->build(description)) {
+    cerr << "Invalid flowgraph: " << graph->error() << endl;
+    exit(1);
+  }
+  return graph;
+}
+
+// The flowgraphs are the reference decoders with extra filters and gains
+// in their audio chains, which the flowgraph's optimizer merges. The
+// design parameters are added to the filters given by a specification,
+// except the AM and NBFM channel filters: their passband is reduced to DC,
+// and a Kaiser window that meets it there is almost three times as long as
+// the equiripple filter and, for NBFM, cuts deeper into the sidebands.
+
+string graphAM(int outRate, int bandwidth, const string& design) {
+  ostringstream graph;
+  graph << "ch = frontend in rate=336000 pass=" << max(0, bandwidth / 2 - 5000)
+        << " stop=" << bandwidth / 2 + 7000 << ";"
+        << "a = am ch; p = resample a rate=336000 cutoff=15000;"
+        << "o = resample p rate=" << outRate << " pass=1000 stop=30000"
+        << design << "; output o";
+  return graph.str();
+}
+
+string graphNBFM(int outRate, int maxF, const string& design) {
+  ostringstream graph;
+  graph << "ch = frontend in rate=48000 pass=" << max(0.0, maxF * 0.8 - 5000)
+        << " stop=" << maxF * 0.8 + 7000 << ";"
+        << "a = fm ch maxf=" << maxF << "; g = gain a db=-6;"
+        << "o = resample g rate=" << outRate << " pass=7500 stop=13000"
+        << design << "; h = gain o db=6; output h";
+  return graph.str();
+}
+
+string graphWBFM(int outRate, const string& design) {
+  ostringstream graph;
+  graph << "ch = frontend in rate=336000 pass=45000 stop=93750" << design
+        << "; a = fm ch maxf=75000; st = stereo a;"
+        << "pm = resample a rate=336000 cutoff=16000;"
+        << "m = resample pm rate=" << outRate << " pass=1000 stop=30000"
+        << design << "; pd = resample st.diff rate=336000 cutoff=16000;"
+        << "d = resample pd rate=" << outRate << " pass=1000 stop=30000"
+        << design << "; x = matrix m d; l = deemph x.left; r = deemph x.right;"
+        << "output l r";
+  return graph.str();
+}
+
+Decoder* makeGraphAM(int inRate, int outRate, int bandwidth) {
+  return makeGraph(inRate, outRate, graphAM(outRate, bandwidth, ""));
+}
+
+Decoder* makeGraphNBFM(int inRate, int outRate, int maxF) {
+  return makeGraph(inRate, outRate, graphNBFM(outRate, maxF, ""));
+}
+
+Decoder* makeGraphWBFM(int inRate, int outRate) {
+  return makeGraph(inRate, outRate, graphWBFM(outRate, ""));
+}
+
+Decoder* makeKaiserAM(int inRate, int outRate, int bandwidth) {
+  return makeGraph(inRate, outRate,
+                   graphAM(outRate, bandwidth, " kaiser=1"));
+}
+
+Decoder* makeKaiserNBFM(int inRate, int outRate, int maxF) {
+  return makeGraph(inRate, outRate, graphNBFM(outRate, maxF, " kaiser=1"));
+}
+
+Decoder* makeKaiserWBFM(int inRate, int outRate) {
+  return makeGraph(inRate, outRate, graphWBFM(outRate, " kaiser=1"));
+}
+
+const Variant kVariants[] = {
+  { "reference", kBlockSize, makeReferenceAM, makeReferenceNBFM,
+    makeReferenceWBFM, makeReferenceFSK },
+  // The filters and the 2 ms blocks of the -lowlatency mode.
+  { "minphase", kInRate / 500 * 2, makeMinPhaseAM, makeMinPhaseNBFM,
+    makeMinPhaseWBFM, makeMinPhaseFSK },
+  // Flowgraphs with merged filter chains; FSK has no flowgraph stages.
+  { "flowgraph", kBlockSize, makeGraphAM, makeGraphNBFM, makeGraphWBFM,
+    makeReferenceFSK },
+  // The same flowgraphs with Kaiser-windowed filters.
+  { "kaiser", kBlockSize, makeKaiserAM, makeKaiserNBFM, makeKaiserWBFM,
+    makeReferenceFSK },
+  { 0, 0, 0, 0, 0, 0 }
+};
+
+/**
+ * A measured quality figure and the limits it must respect.
+ */
+struct Metric {
+  string name;
+  float value;
+  float limit;
+  bool higherIsBetter;
+  /** How much worse than the reference the value may be. */
+  float tolerance;
+  /** Whether the tolerance is a factor rather than a difference. */
+  bool relative;
+};
+
+struct Config {
+  string variant;
+  double seconds;
+  float snr;
+};
+
+/**
+ * Generates the test signal for a case, converted through the u8 path.
+ */
+vector<uint8_t> makeInput(int testCase, const Config& cfg) {
+  int modulation = testCase == CASE_AM ? SIGNAL_AM
+      : testCase == CASE_NBFM || testCase == CASE_NBFM_FREQCORR
+      || testCase == CASE_NBFM_IQCORRECT ? SIGNAL_NBFM
+      : testCase == CASE_FSK || testCase == CASE_G3RUH || testCase == CASE_AX25
+      || testCase == CASE_AX25_DOPPLER ? SIGNAL_FSK : SIGNAL_WBFM;
+  SignalSpec spec = defaultSignalSpec(modulation, kInRate);
+  spec.snr = cfg.snr;
+  bool ax25 = testCase == CASE_AX25 || testCase == CASE_AX25_DOPPLER;
+  spec.scramble = testCase == CASE_G3RUH || ax25;
+  spec.hdlc = ax25;
+  if (testCase == CASE_AX25_DOPPLER) {
+    spec.freqOffset = kDopplerStart;
+    spec.freqDrift = kDopplerRate;
+  }
+  if (testCase == CASE_WBFM_MONO) {
+    spec.rightToneFreq = spec.toneFreq;
+  }
+  if (testCase == CASE_NBFM_FREQCORR || testCase == CASE_NBFM_IQCORRECT) {
+    spec.freqOffset = kFreqError;
+  }
+  if (testCase == CASE_NBFM_IQCORRECT) {
+    // An RTL-SDR-like tuner, whose DC offset ends up in the channel.
+    spec.dcOffset = 0.05;
+    spec.iqGain = 1.1;
+    spec.iqPhase = 5;
+  }
+  SignalGenerator generator(spec);
+  Samples samples(generator.generate(kInRate * cfg.seconds));
+  vector<uint8_t> out(samples.size());
+  samplesToUint8(samples.data(), samples.size(), out.data());
+  return out;
+}
+
+/**
+ * Runs the variant's decoder for the case over the whole input.
+ */
+StereoAudio decodeAll(const Variant& variant, int testCase,
+                      vector<uint8_t>& input, const Config& cfg) {
+  unique_ptr<Decoder> decoder;
+  switch (testCase) {
+  case CASE_AM:
+    decoder.reset(variant.makeAM(kInRate, kOutRate, 10000));
+    break;
+  case CASE_NBFM:
+  case CASE_NBFM_FREQCORR:
+  case CASE_NBFM_IQCORRECT:
+    decoder.reset(variant.makeNBFM(kInRate, kOutRate, 5000));
+    break;
+  case CASE_FSK:
+    decoder.reset(variant.makeNBFM(kInRate, kOutRate, 3500));
+    break;
+  case CASE_G3RUH:
+  case CASE_AX25:
+  case CASE_AX25_DOPPLER:
+    decoder.reset(variant.makeFSK(kInRate, 9600, 3000));
+    break;
+  default:
+    decoder.reset(variant.makeWBFM(kInRate, kOutRate));
+  }
+  bool inStereo = testCase == CASE_WBFM_STEREO;
+  unique_ptr<NCO> nco;
+  if (testCase == CASE_NBFM_FREQCORR || testCase == CASE_NBFM_IQCORRECT) {
+    nco.reset(new NCO(kInRate, -kFreqError));
+  }
+  DopplerTable doppler;
+  if (testCase == CASE_AX25_DOPPLER) {
+    doppler.add(0, kDopplerStart);
+    doppler.add(cfg.seconds, kDopplerStart + kDopplerRate * cfg.seconds);
+    nco.reset(new NCO(kInRate, 0));
+  }
+  unique_ptr<IQCorrector> corrector;
+  if (testCase == CASE_NBFM_IQCORRECT) {
+    corrector.reset(new IQCorrector());
+  }
+
+  StereoAudio all;
+  int blockSize = variant.blockSize;
+  for (int pos = 0; pos + blockSize <= input.size(); pos += blockSize) {
+    if (!doppler.empty()) {
+      nco->setFrequency(-doppler.offsetAt((pos + blockSize / 2) / 2.0
+                                          / kInRate));
+    }
+    Samples samples(
+        samplesFromUint8(input.data() + pos, blockSize, nco.get(),
+                         corrector.get()));
+    StereoAudio audio = decoder->decode(samples, inStereo);
+    all.left.insert(all.left.end(), audio.left.begin(), audio.left.end());
+    all.right.insert(all.right.end(), audio.right.begin(), audio.right.end());
+  }
+  return all;
+}
+
+vector<Metric> measure(int testCase, const StereoAudio& audio) {
+  // Leaves time for the filters and the stereo pilot detector to settle.
+  int skip = kOutRate / 2;
+  SignalSpec spec = defaultSignalSpec(SIGNAL_WBFM, kInRate);
+  vector<Metric> metrics;
+  if (testCase == CASE_FSK) {
+    float ber = prbsBitErrorRate(audio.left, skip, kOutRate, spec.baudRate);
+    metrics.push_back(Metric{"ber", ber, 1e-3, false, 2, true});
+    return metrics;
+  }
+  if (testCase == CASE_G3RUH) {
+    // The decoder outputs one soft decision per bit.
+    vector<uint8_t> bits;
+    for (int i = spec.baudRate / 2; i < audio.left.size(); ++i) {
+      bits.push_back(audio.left[i] > 0);
+    }
+    float ber = bits.empty() ? 1 : (float) countPrbsErrors(bits) / bits.size();
+    metrics.push_back(Metric{"ber", ber, 1e-3, false, 2, true});
+    return metrics;
+  }
+  if (testCase == CASE_AX25 || testCase == CASE_AX25_DOPPLER) {
+    // The frames are numbered, so the ones missing between the first and
+    // the last decoded are the ones lost.
+    HdlcDeframer hdlc;
+    vector<vector<uint8_t> > frames;
+    hdlc.process(audio.left, &frames);
+    int first = -1;
+    int last = -1;
+    int numbered = 0;
+    for (const vector<uint8_t>& frame : frames) {
+      // Too short to hold a number, so not one of the frames sent.
+      if (frame.size() < 25) {
+        continue;
+      }
+      int seq = atoi(string(frame.begin() + 20, frame.begin() + 25).c_str());
+      first = first < 0 ? seq : first;
+      last = seq;
+      ++numbered;
+    }
+    float loss = numbered < 2 ? 1 : 1 - (float) numbered / (last - first + 1);
+    metrics.push_back(Metric{"frame_loss", loss, 0.01, false, 0.01, false});
+    return metrics;
+  }
+  if (testCase == CASE_WBFM_STEREO) {
+    int len = audio.left.size() - skip;
+    float lInL = toneAmplitude(audio.left, skip, len, kOutRate,
+                               spec.toneFreq);
+    float lInR = toneAmplitude(audio.right, skip, len, kOutRate,
+                               spec.toneFreq);
+    float rInR = toneAmplitude(audio.right, skip, len, kOutRate,
+                               spec.rightToneFreq);
+    float rInL = toneAmplitude(audio.left, skip, len, kOutRate,
+                               spec.rightToneFreq);
+    metrics.push_back(Metric{"separation_left_db",
+                             (float) (20 * log10(rInR / rInL)),
+                             15, true, 1, false});
+    metrics.push_back(Metric{"separation_right_db",
+                             (float) (20 * log10(lInL / lInR)),
+                             15, true, 1, false});
+    return metrics;
+  }
+  ToneMeasurement tone = measureTone(audio.left, skip, kOutRate,
+                                     spec.toneFreq);
+  // The NBFM front-end filter cuts into the signal's sidebands, which is
+  // visible as distortion.
+  float maxThd = testCase == CASE_NBFM || testCase == CASE_NBFM_FREQCORR
+      || testCase == CASE_NBFM_IQCORRECT ? -20 : -40;
+  metrics.push_back(Metric{"snr_db", tone.snr, 30, true, 1, false});
+  metrics.push_back(Metric{"thd_db", tone.thd, maxThd, false, 1, false});
+  return metrics;
+}
+
+bool check(const Metric& m, const Metric* ref, string* why) {
+  bool ok = m.higherIsBetter ? m.value >= m.limit : m.value <= m.limit;
+  if (!ok) {
+    *why = "limit";
+    return false;
+  }
+  if (ref) {
+    float allowed;
+    if (m.relative) {
+      allowed = m.higherIsBetter ? ref->value / m.tolerance
+          : ref->value * m.tolerance + 1e-4;
+    } else {
+      allowed = m.higherIsBetter ? ref->value - m.tolerance
+          : ref->value + m.tolerance;
+    }
+    ok = m.higherIsBetter ? m.value >= allowed : m.value <= allowed;
+    if (!ok) {
+      *why = "reference";
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * Looks up the golden figure for a metric of a case.
+ * @return The figure, or 0 if there is none.
+ */
+const Golden* findGolden(const string& testCase, const string& metric) {
+  for (int i = 0; kGolden[i].testCase; ++i) {
+    if (testCase == kGolden[i].testCase && metric == kGolden[i].metric) {
+      return &kGolden[i];
+    }
+  }
+  return 0;
+}
+
+/**
+ * Checks a reference figure against its golden figure.
+ */
+bool checkGolden(const Metric& m, const Golden& golden) {
+  return m.higherIsBetter ? m.value >= golden.value - golden.tolerance
+      : m.value <= golden.value + golden.tolerance;
+}
+
+int main(int argc, char* argv[]) {
+  Config cfg { "", kDefaultSeconds, kDefaultSnr };
+
+  for (int i = 1; i < argc; ++i) {
+    if (string("-variant") == argv[i]) {
+      cfg.variant = argv[++i];
+    } else if (string("-seconds") == argv[i]) {
+      cfg.seconds = stod(argv[++i]);
+    } else if (string("-snr") == argv[i]) {
+      cfg.snr = stof(argv[++i]);
+    } else {
+      cerr << "Unknown flag: " << argv[i] << endl;
+      return 1;
+    }
+  }
+
+  int failures = 0;
+  bool useGolden = cfg.seconds == kDefaultSeconds && cfg.snr == kDefaultSnr;
+  cout << "case,variant,metric,value,reference,golden,limit,result" << endl;
+  for (int c = 0; kCases[c]; ++c) {
+    vector<uint8_t> input(makeInput(c, cfg));
+    vector<Metric> reference(measure(c, decodeAll(kVariants[0], c, input, cfg)));
+    for (int v = 0; kVariants[v].name; ++v) {
+      const Variant& variant = kVariants[v];
+      if (!cfg.variant.empty() && cfg.variant != variant.name
+          && v != 0) {
+        continue;
+      }
+      vector<Metric> metrics(v == 0 ? reference
+                             : measure(c, decodeAll(variant, c, input, cfg)));
+      for (int m = 0; m < metrics.size(); ++m) {
+        string why;
+        bool ok = check(metrics[m], v == 0 ? 0 : &reference[m], &why);
+        const Golden* golden =
+            useGolden ? findGolden(kCases[c], metrics[m].name) : 0;
+        if (ok && v == 0 && golden && !checkGolden(metrics[m], *golden)) {
+          ok = false;
+          why = "golden";
+        }
+        if (!ok) {
+          ++failures;
+        }
+        cout << kCases[c] << "," << variant.name << "," << metrics[m].name
+             << "," << metrics[m].value << "," << reference[m].value << ",";
+        if (golden) {
+          cout << golden->value;
+        }
+        cout << "," << metrics[m].limit << ","
+             << (ok ? "PASS" : "FAIL " + why) << endl;
+      }
+    }
+  }
+  if (failures) {
+    cerr << failures << " check(s) failed" << endl;
+    return 1;
+  }
+  return 0;
+}
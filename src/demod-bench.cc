@@ -0,0 +1,250 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * Microbenchmarks for the DSP kernels. Writes one result line per kernel
+ * configuration as CSV (default) or JSON lines to the standard output.
+ */
+#include <chrono>
+#include <iostream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "dsp.h"
+
+using namespace radioreceiver;
+using namespace std;
+
+const int kTapCounts[] = { 41, 101, 351, 0 };
+const int kBlockSizes[] = { 4096, 65536, 1048576, 0 };
+
+enum {
+  FORMAT_CSV = 0,
+  FORMAT_JSON = 1
+};
+
+struct Config {
+  string kernel;
+  double minTime;
+  int format;
+};
+
+struct Result {
+  string kernel;
+  int taps;
+  int block;
+  long iterations;
+  double nsPerSample;
+};
+
+// Keeps the compiler from discarding the results of the kernels.
+static volatile float sink;
+
+/**
+ * Runs the given body until at least minTime seconds have passed and
+ * returns the mean time per sample.
+ */
+template <typename Body>
+Result measure(const string& kernel, int taps, int block, double minTime,
+               Body body) {
+  typedef chrono::steady_clock Clock;
+  body();
+  long iterations = 0;
+  Clock::time_point start = Clock::now();
+  double elapsed = 0;
+  do {
+    body();
+    ++iterations;
+    elapsed = chrono::duration<double>(Clock::now() - start).count();
+  } while (elapsed < minTime);
+  return Result{kernel, taps, block, iterations,
+                elapsed * 1e9 / ((double) iterations * block)};
+}
+
+void printHeader(const Config& cfg) {
+  if (cfg.format == FORMAT_CSV) {
+    cout << "kernel,taps,block,iterations,ns_per_sample,msamples_per_s"
+         << endl;
+  }
+}
+
+void printResult(const Config& cfg, const Result& r) {
+  double msps = 1e3 / r.nsPerSample;
+  if (cfg.format == FORMAT_CSV) {
+    cout << r.kernel << "," << r.taps << "," << r.block << ","
+         << r.iterations << "," << r.nsPerSample << "," << msps << endl;
+  } else {
+    cout << "{\"kernel\":\"" << r.kernel << "\",\"taps\":" << r.taps
+         << ",\"block\":" << r.block << ",\"iterations\":" << r.iterations
+         << ",\"ns_per_sample\":" << r.nsPerSample
+         << ",\"msamples_per_s\":" << msps << "}" << endl;
+  }
+}
+
+/**
+ * Returns a block of pseudo-random samples in the [-1, 1) range.
+ */
+Samples randomSamples(int length) {
+  Samples out(length);
+  uint32_t state = 12345;
+  for (int i = 0; i < length; ++i) {
+    state = state * 1664525 + 1013904223;
+    out[i] = (state >> 8) / 8388608.0f - 1;
+  }
+  return out;
+}
+
+/**
+ * Tells whether -kernel selects a kernel: all of them if it is empty, the
+ * ones starting with its text if it ends with '*', or else the one whose
+ * name it is.
+ */
+bool selected(const Config& cfg, const string& name) {
+  const string& pattern = cfg.kernel;
+  if (pattern.empty()) {
+    return true;
+  }
+  if (pattern[pattern.size() - 1] == '*') {
+    return name.compare(0, pattern.size() - 1, pattern, 0,
+                        pattern.size() - 1) == 0;
+  }
+  return name == pattern;
+}
+
+void runKernels(const Config& cfg) {
+  for (int b = 0; kBlockSizes[b]; ++b) {
+    int block = kBlockSizes[b];
+    Samples input(randomSamples(block));
+    vector<uint8_t> u8(block);
+    vector<int16_t> i16(block);
+    for (int i = 0; i < block; ++i) {
+      u8[i] = (input[i] + 1) * 127.5f;
+      i16[i] = input[i] * 32767;
+    }
+
+    if (selected(cfg, "convert_u8")) {
+      printResult(cfg, measure("convert_u8", 0, block, cfg.minTime, [&]() {
+        sink = samplesFromUint8(u8.data(), block)[block - 1];
+      }));
+    }
+
+    if (selected(cfg, "convert_u8_nco")) {
+      NCO nco(1024000, 1000);
+      printResult(cfg, measure("convert_u8_nco", 0, block, cfg.minTime, [&]() {
+        sink = samplesFromUint8(u8.data(), block, &nco)[block - 1];
+      }));
+    }
+
+    if (selected(cfg, "convert_u8_iqcorrect")) {
+      IQCorrector corrector;
+      printResult(cfg, measure("convert_u8_iqcorrect", 0, block, cfg.minTime,
+                               [&]() {
+        sink = samplesFromUint8(u8.data(), block, 0, &corrector)[block - 1];
+      }));
+    }
+
+    if (selected(cfg, "convert_i16")) {
+      printResult(cfg, measure("convert_i16", 0, block, cfg.minTime, [&]() {
+        sink = samplesFromInt16(i16.data(), block)[block - 1];
+      }));
+    }
+
+    for (int t = 0; kTapCounts[t]; ++t) {
+      int taps = kTapCounts[t];
+      vector<float> coefs(getLowPassFIRCoeffs(1024000, 100000, taps));
+
+      if (selected(cfg, "fir_get")) {
+        FIRFilter filter(coefs, 1);
+        printResult(cfg, measure("fir_get", taps, block, cfg.minTime, [&]() {
+          filter.loadSamples(input);
+          float acc = 0;
+          for (int i = 0; i < block; ++i) {
+            acc += filter.get(i);
+          }
+          sink = acc;
+        }));
+      }
+
+      if (selected(cfg, "fir_get_iq")) {
+        FIRFilter filter(coefs, 2);
+        printResult(cfg, measure("fir_get_iq", taps, block, cfg.minTime,
+                                 [&]() {
+          filter.loadSamples(input);
+          float acc = 0;
+          for (int i = 0; i < block; ++i) {
+            acc += filter.get(i);
+          }
+          sink = acc;
+        }));
+      }
+    }
+
+    if (selected(cfg, "myatan2")) {
+      printResult(cfg, measure("myatan2", 0, block, cfg.minTime, [&]() {
+        float acc = 0;
+        for (int i = 0; i < block - 1; ++i) {
+          acc += myatan2(input[i], input[i + 1]);
+        }
+        sink = acc;
+      }));
+    }
+
+    if (selected(cfg, "stereo_separate")) {
+      StereoSeparator separator(336000, 19000);
+      printResult(cfg, measure("stereo_separate", 0, block, cfg.minTime,
+                               [&]() {
+        sink = separator.separate(input).diff[block - 1];
+      }));
+    }
+
+    if (selected(cfg, "deemphasis")) {
+      Deemphasizer deemph(48000, 50);
+      Samples work(input);
+      printResult(cfg, measure("deemphasis", 0, block, cfg.minTime, [&]() {
+        deemph.inPlace(work);
+        sink = work[block - 1];
+      }));
+    }
+  }
+}
+
+int main(int argc, char* argv[]) {
+  Config cfg { "", 0.2, FORMAT_CSV };
+
+  for (int i = 1; i < argc; ++i) {
+    if (string("-kernel") == argv[i]) {
+      cfg.kernel = argv[++i];
+    } else if (string("-mintime") == argv[i]) {
+      cfg.minTime = stoi(argv[++i]) / 1000.0;
+    } else if (string("-format") == argv[i]) {
+      string format = string(argv[++i]);
+      if (format == "csv") {
+        cfg.format = FORMAT_CSV;
+      } else if (format == "json") {
+        cfg.format = FORMAT_JSON;
+      } else {
+        cerr << "Unknown format: " << format << endl;
+        return 1;
+      }
+    } else {
+      cerr << "Unknown flag: " << argv[i] << endl;
+      return 1;
+    }
+  }
+
+  printHeader(cfg);
+  runKernels(cfg);
+  return 0;
+}
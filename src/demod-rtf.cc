@@ -0,0 +1,295 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * Measures how many times faster than real time each decoder runs by
+ * feeding it synthetic IQ data from memory. Writes one result line per
+ * configuration as CSV (default) or JSON lines to the standard output.
+ */
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "dsp.h"
+#include "am_decoder.h"
+#include "nbfm_decoder.h"
+#include "siggen.h"
+#include "wbfm_decoder.h"
+
+using namespace radioreceiver;
+using namespace std;
+
+const char* kModes[] = { "AM", "NBFM", "WBFM", "WBFM-stereo", 0 };
+const char* inputTypes[] = { "u8", "i16", "cf32", 0 };
+const int kInRates[] = { 1024000, 2048000, 0 };
+
+enum {
+  MODE_AM = 0,
+  MODE_NBFM = 1,
+  MODE_WBFM = 2,
+  MODE_WBFM_STEREO = 3
+};
+
+enum {
+  INPUT_TYPE_U8 = 0,
+  INPUT_TYPE_I16 = 1,
+  INPUT_TYPE_CF32 = 2
+};
+
+enum {
+  FORMAT_CSV = 0,
+  FORMAT_JSON = 1
+};
+
+struct Config {
+  int mode;
+  int inType;
+  int inRate;
+  int blockSize;
+  double seconds;
+  int format;
+};
+
+// Keeps the compiler from discarding the decoded audio.
+static volatile float sink;
+
+struct Result {
+  int mode;
+  int inType;
+  int inRate;
+  double wallTime;
+  double cpuTime;
+  double seconds;
+  long peakRssKb;
+};
+
+/**
+ * Returns the user plus system CPU time used by the process, in seconds.
+ */
+double cpuTime() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6
+      + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+/**
+ * Generates the given duration of a test signal for the mode and encodes
+ * it in the given input format.
+ */
+vector<char> synthesize(int mode, int inType, int rate, double seconds) {
+  int modulation = mode == MODE_AM ? SIGNAL_AM
+      : mode == MODE_NBFM ? SIGNAL_NBFM : SIGNAL_WBFM;
+  SignalGenerator generator(defaultSignalSpec(modulation, rate));
+  Samples samples(generator.generate(rate * seconds));
+  if (inType == INPUT_TYPE_CF32) {
+    const char* data = reinterpret_cast<const char*>(samples.data());
+    return vector<char>(data, data + samples.size() * sizeof(float));
+  }
+  vector<char> out;
+  if (inType == INPUT_TYPE_U8) {
+    out.resize(samples.size());
+    samplesToUint8(samples.data(), samples.size(),
+                   reinterpret_cast<uint8_t*>(out.data()));
+  } else {
+    out.resize(samples.size() * sizeof(int16_t));
+    samplesToInt16(samples.data(), samples.size(),
+                   reinterpret_cast<int16_t*>(out.data()));
+  }
+  return out;
+}
+
+Decoder* makeDecoder(int mode, int inRate) {
+  switch (mode) {
+  case MODE_AM:
+    return new AMDecoder(inRate, 48000, 10000);
+  case MODE_NBFM:
+    return new NBFMDecoder(inRate, 48000, 10000);
+  default:
+    return new WBFMDecoder(inRate, 48000);
+  }
+}
+
+Result run(const Config& cfg, int mode, int inType, int inRate) {
+  typedef chrono::steady_clock Clock;
+  vector<char> input(synthesize(mode, inType, inRate, cfg.seconds));
+  unique_ptr<Decoder> decoder(makeDecoder(mode, inRate));
+  bool inStereo = mode == MODE_WBFM_STEREO;
+  int blockSize = cfg.blockSize;
+
+  double cpuStart = cpuTime();
+  Clock::time_point start = Clock::now();
+  for (int pos = 0; pos + blockSize <= input.size(); pos += blockSize) {
+    char* block = input.data() + pos;
+    StereoAudio audio;
+    if (inType == INPUT_TYPE_U8) {
+      audio = decoder->decode(
+          samplesFromUint8(reinterpret_cast<uint8_t*>(block), blockSize),
+          inStereo);
+    } else if (inType == INPUT_TYPE_I16) {
+      audio = decoder->decode(
+          samplesFromInt16(reinterpret_cast<int16_t*>(block), blockSize / 2),
+          inStereo);
+    } else {
+      audio = decoder->decode(
+          samplesFromFloat32(reinterpret_cast<float*>(block), blockSize / 4),
+          inStereo);
+    }
+    if (!audio.left.empty()) {
+      sink = audio.left[0];
+    }
+  }
+  double wall = chrono::duration<double>(Clock::now() - start).count();
+  double cpu = cpuTime() - cpuStart;
+  return Result{mode, inType, inRate, wall, cpu, cfg.seconds, 0};
+}
+
+/**
+ * Runs a configuration in a child process, so that its peak resident set
+ * size isn't the high-water mark left by the configurations before it.
+ */
+Result runInChild(const Config& cfg, int mode, int inType, int inRate) {
+  int fds[2];
+  if (pipe(fds) != 0) {
+    cerr << "pipe: " << strerror(errno) << endl;
+    exit(1);
+  }
+  pid_t pid = fork();
+  if (pid < 0) {
+    cerr << "fork: " << strerror(errno) << endl;
+    exit(1);
+  }
+  if (pid == 0) {
+    close(fds[0]);
+    Result result = run(cfg, mode, inType, inRate);
+    bool written = write(fds[1], &result, sizeof(result)) == sizeof(result);
+    _exit(written ? 0 : 1);
+  }
+  close(fds[1]);
+  Result result;
+  bool complete = read(fds[0], &result, sizeof(result)) == sizeof(result);
+  close(fds[0]);
+  int status;
+  struct rusage usage;
+  wait4(pid, &status, 0, &usage);
+  if (!complete || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    cerr << "The run of " << kModes[mode] << " with " << inputTypes[inType]
+         << " input at " << inRate << " Hz failed" << endl;
+    exit(1);
+  }
+  result.peakRssKb = usage.ru_maxrss;
+  return result;
+}
+
+void printHeader(const Config& cfg) {
+  if (cfg.format == FORMAT_CSV) {
+    cout << "mode,inputtype,inrate,signal_s,wall_s,realtime_factor,"
+         << "cpu_s_per_signal_s,peak_rss_kb" << endl;
+  }
+}
+
+void printResult(const Config& cfg, const Result& r) {
+  double rtf = r.seconds / r.wallTime;
+  double cpuPerSecond = r.cpuTime / r.seconds;
+  if (cfg.format == FORMAT_CSV) {
+    cout << kModes[r.mode] << "," << inputTypes[r.inType] << ","
+         << r.inRate << "," << r.seconds << "," << r.wallTime << ","
+         << rtf << "," << cpuPerSecond << "," << r.peakRssKb << endl;
+  } else {
+    cout << "{\"mode\":\"" << kModes[r.mode] << "\",\"inputtype\":\""
+         << inputTypes[r.inType] << "\",\"inrate\":" << r.inRate
+         << ",\"signal_s\":" << r.seconds << ",\"wall_s\":" << r.wallTime
+         << ",\"realtime_factor\":" << rtf
+         << ",\"cpu_s_per_signal_s\":" << cpuPerSecond
+         << ",\"peak_rss_kb\":" << r.peakRssKb << "}" << endl;
+  }
+}
+
+/**
+ * Looks up a name in a null-terminated list of names.
+ * @return The name's index, or -1 if it's not in the list.
+ */
+int lookup(const char* names[], const string& name) {
+  for (int i = 0; names[i]; ++i) {
+    if (name == string(names[i])) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+int main(int argc, char* argv[]) {
+  Config cfg { -1, -1, 0, 65536, 4, FORMAT_CSV };
+
+  for (int i = 1; i < argc; ++i) {
+    if (string("-mod") == argv[i]) {
+      string modName = string(argv[++i]);
+      cfg.mode = lookup(kModes, modName);
+      if (cfg.mode == -1) {
+        cerr << "Unknown modulation: " << modName << endl;
+        return 1;
+      }
+    } else if (string("-inputtype") == argv[i]) {
+      string typeName = string(argv[++i]);
+      cfg.inType = lookup(inputTypes, typeName);
+      if (cfg.inType == -1) {
+        cerr << "Unknown input type: " << typeName << endl;
+        return 1;
+      }
+    } else if (string("-inrate") == argv[i]) {
+      cfg.inRate = stoi(argv[++i]);
+    } else if (string("-blocksize") == argv[i]) {
+      cfg.blockSize = stoi(argv[++i]);
+      cfg.blockSize -= (cfg.blockSize % 8);
+    } else if (string("-seconds") == argv[i]) {
+      cfg.seconds = stod(argv[++i]);
+    } else if (string("-format") == argv[i]) {
+      string format = string(argv[++i]);
+      if (format == "csv") {
+        cfg.format = FORMAT_CSV;
+      } else if (format == "json") {
+        cfg.format = FORMAT_JSON;
+      } else {
+        cerr << "Unknown format: " << format << endl;
+        return 1;
+      }
+    } else {
+      cerr << "Unknown flag: " << argv[i] << endl;
+      return 1;
+    }
+  }
+
+  printHeader(cfg);
+  for (int mode = 0; kModes[mode]; ++mode) {
+    if (cfg.mode != -1 && mode != cfg.mode) continue;
+    for (int inType = 0; inputTypes[inType]; ++inType) {
+      if (cfg.inType != -1 && inType != cfg.inType) continue;
+      for (int r = 0; kInRates[r]; ++r) {
+        int inRate = cfg.inRate ? cfg.inRate : kInRates[r];
+        printResult(cfg, runInChild(cfg, mode, inType, inRate));
+        if (cfg.inRate) break;
+      }
+    }
+  }
+  return 0;
+}
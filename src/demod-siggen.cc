@@ -0,0 +1,150 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * Generates a synthetic raw I/Q stream and writes it to the standard output
+ * in the same formats demod reads.
+ */
+#include <iostream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "siggen.h"
+
+using namespace radioreceiver;
+using namespace std;
+
+const char* kMods[] = { "AM", "NBFM", "FSK", "WBFM", 0 };
+const char* outputTypes[] = { "u8", "i16", "cf32", 0 };
+
+enum {
+  OUTPUT_TYPE_U8 = 0,
+  OUTPUT_TYPE_I16 = 1,
+  OUTPUT_TYPE_CF32 = 2
+};
+
+const int kChunkSize = 65536;
+
+int lookup(const char* names[], const string& name) {
+  for (int i = 0; names[i]; ++i) {
+    if (name == string(names[i])) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+int main(int argc, char* argv[]) {
+  int mod = SIGNAL_NBFM;
+  int rate = 1024000;
+  int outType = OUTPUT_TYPE_U8;
+  double seconds = 10;
+
+  // The modulation and rate decide the defaults for everything else, so
+  // they are parsed first.
+  for (int i = 1; i + 1 < argc; ++i) {
+    if (string("-mod") == argv[i]) {
+      mod = lookup(kMods, argv[i + 1]);
+      if (mod == -1) {
+        cerr << "Unknown modulation: " << argv[i + 1] << endl;
+        return 1;
+      }
+    } else if (string("-rate") == argv[i]) {
+      rate = stoi(argv[i + 1]);
+    }
+  }
+  SignalSpec spec = defaultSignalSpec(mod, rate);
+
+  for (int i = 1; i < argc; ++i) {
+    if (string("-mod") == argv[i] || string("-rate") == argv[i]) {
+      ++i;
+    } else if (string("-outputtype") == argv[i]) {
+      string typeName = string(argv[++i]);
+      outType = lookup(outputTypes, typeName);
+      if (outType == -1) {
+        cerr << "Unknown output type: " << typeName << endl;
+        return 1;
+      }
+    } else if (string("-seconds") == argv[i]) {
+      seconds = stod(argv[++i]);
+    } else if (string("-ampl") == argv[i]) {
+      spec.amplitude = stof(argv[++i]);
+    } else if (string("-tone") == argv[i]) {
+      spec.toneFreq = stof(argv[++i]);
+    } else if (string("-righttone") == argv[i]) {
+      spec.rightToneFreq = stof(argv[++i]);
+    } else if (string("-depth") == argv[i]) {
+      spec.depth = stof(argv[++i]);
+    } else if (string("-maxf") == argv[i]) {
+      spec.maxF = stof(argv[++i]);
+    } else if (string("-baud") == argv[i]) {
+      spec.baudRate = stoi(argv[++i]);
+    } else if (string("-offset") == argv[i]) {
+      spec.freqOffset = stof(argv[++i]);
+    } else if (string("-drift") == argv[i]) {
+      spec.freqDrift = stof(argv[++i]);
+    } else if (string("-snr") == argv[i]) {
+      spec.snr = stof(argv[++i]);
+    } else if (string("-seed") == argv[i]) {
+      spec.seed = stoul(argv[++i]);
+    } else if (string("-scramble") == argv[i]) {
+      spec.scramble = true;
+    } else if (string("-hdlc") == argv[i]) {
+      spec.hdlc = true;
+    } else if (string("-dc") == argv[i]) {
+      spec.dcOffset = stof(argv[++i]);
+    } else if (string("-iqgain") == argv[i]) {
+      spec.iqGain = stof(argv[++i]);
+    } else if (string("-iqphase") == argv[i]) {
+      spec.iqPhase = stof(argv[++i]);
+    } else {
+      cerr << "Unknown flag: " << argv[i] << endl;
+      return 1;
+    }
+  }
+
+  SignalGenerator generator(spec);
+  Samples samples(2 * kChunkSize);
+  vector<char> out(2 * kChunkSize * sizeof(float));
+  // A zero or negative duration means that the stream never ends.
+  int64_t remaining = seconds > 0 ? (int64_t) (seconds * rate) : -1;
+
+  while (remaining != 0 && cout.good()) {
+    int count = kChunkSize;
+    if (remaining > 0 && remaining < count) {
+      count = remaining;
+    }
+    generator.generate(samples.data(), count);
+    const char* data = out.data();
+    int bytes;
+    if (outType == OUTPUT_TYPE_U8) {
+      samplesToUint8(samples.data(), 2 * count,
+                     reinterpret_cast<uint8_t*>(out.data()));
+      bytes = 2 * count;
+    } else if (outType == OUTPUT_TYPE_I16) {
+      samplesToInt16(samples.data(), 2 * count,
+                     reinterpret_cast<int16_t*>(out.data()));
+      bytes = 4 * count;
+    } else {
+      data = reinterpret_cast<const char*>(samples.data());
+      bytes = 8 * count;
+    }
+    cout.write(data, bytes);
+    if (remaining > 0) {
+      remaining -= count;
+    }
+  }
+  return 0;
+}
@@ -16,31 +16,80 @@
  * Demodulates a captured signal and writes the demodulated signal as a
  * raw 16-bit signed little-endian stereo stream.
  */
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "dsp.h"
 #include "am_decoder.h"
+#include "burst.h"
+#include "doppler.h"
+#include "flowgraph.h"
+#include "fsk_decoder.h"
+#include "hdlc.h"
+#include "metrics.h"
 #include "nbfm_decoder.h"
+#include "overrun.h"
+#include "perf_counters.h"
+#include "stats.h"
+#include "trace.h"
 #include "wbfm_decoder.h"
 
 using namespace radioreceiver;
 using namespace std;
 
-const char* kMods[] = { "AM", "WBFM", "NBFM", 0 };
-const char* inputTypes[] = { "u8", "i16", 0 };
+const char* kMods[] = { "AM", "WBFM", "NBFM", "FSK", 0 };
+const char* inputTypes[] = { "u8", "i16", "cf32", 0 };
+const char* overrunPolicies[] = { "none", "report", "drop", "degrade", 0 };
+const char* squelchModes[] = { "silence", "skip", 0 };
+const char* burstModes[] = { "none", "raw", "framed", "files", 0 };
+const char* bitFormats[] = { "hard", "soft", 0 };
 
 enum {
   MODULATION_AM = 0,
   MODULATION_WBFM = 1,
-  MODULATION_NBFM = 2
+  MODULATION_NBFM = 2,
+  MODULATION_FSK = 3
 };
 
 enum {
   INPUT_TYPE_U8 = 0,
-  INPUT_TYPE_I16 = 1
+  INPUT_TYPE_I16 = 1,
+  INPUT_TYPE_CF32 = 2
 };
 
+enum {
+  SQUELCH_SILENCE = 0,
+  SQUELCH_SKIP = 1
+};
+
+enum {
+  BITS_HARD = 0,
+  BITS_SOFT = 1
+};
+
+enum {
+  BURST_NONE = 0,
+  BURST_RAW = 1,
+  BURST_FRAMED = 2,
+  BURST_FILES = 3
+};
+
+// How far below the squelch level the channel must fall to close it, in dB.
+const float kSquelchHysteresis = 3;
+
+// The size in bytes of a complex sample in each input type.
+const int kSampleBytes[] = { 2, 4, 8 };
+
+// The number of blocks per second read in the low-latency mode; 2 ms each.
+const int kLowLatencyBlocks = 500;
+
 struct Config {
   int mod;
   int channels;
@@ -51,22 +100,175 @@ struct Config {
   int outRate;
   int inType;
   bool outSquared;
+  bool stats;
+  double statsInterval;
+  bool perf;
+  bool latency;
+  bool lowLatency;
+  int overrunPolicy;
+  int64_t maxBacklog;
+  int pipeSize;
+  string traceFile;
+  string metricsFile;
+  string metricsSocket;
+  bool squelch;
+  float squelchLevel;
+  int squelchMode;
+  int burstMode;
+  int burstPre;
+  int burstPost;
+  string burstDir;
+  int baudRate;
+  int bitFormat;
+  bool descramble;
+  bool kiss;
+  vector<pair<int, string> > extraOutputs;
+  vector<pair<int, string> > extraDecoders;
+  double freqCorr;
+  double ppm;
+  double centerFreq;
+  bool iqCorrect;
+  string dopplerFile;
+  double dopplerStart;
+  string graph;
+  string graphFile;
+};
+
+/**
+ * Converts the audio into raw 16-bit signed little-endian samples,
+ * interleaving the channels if the output is in stereo.
+ */
+void packAudio(const StereoAudio& audio, const Config& cfg, vector<char>* out) {
+  int frameSize = 2 * cfg.channels;
+  out->resize(audio.left.size() * frameSize);
+  char* outBlock = out->data();
+  for (int i = 0; i < audio.left.size(); ++i, outBlock += frameSize) {
+    int left = audio.left[i] * 32767;
+
+    // make output square like for multimon-ng
+    if (cfg.outSquared) {
+      if (left > 0) left = 32767;
+      if (left < 0) left = -32767;
+    }
+
+    if (left > 32767) left = 32767;
+    if (left < -32767) left = -32767;
+    outBlock[0] = left & 0xff;
+    outBlock[1] = (left >> 8) & 0xff;
+
+    if (cfg.channels == 2) {
+      int right = audio.right[i] * 32767;
+      if (right > 32767) right = 32767;
+      if (right < -32767) right = -32767;
+      outBlock[2] = right & 0xff;
+      outBlock[3] = (right >> 8) & 0xff;
+    }
+  }
+}
+
+/**
+ * Packs FSK symbols into bits, eight to a byte with the first bit in the
+ * most significant position, or into one signed byte of soft decision per
+ * bit. Hard bits that don't fill a byte are kept for the next block.
+ */
+class BitPacker {
+  uint8_t byte_;
+  int count_;
+
+ public:
+  BitPacker() : byte_(0), count_(0) {}
+
+  void pack(const Samples& symbols, int format, vector<char>* out) {
+    out->clear();
+    for (float symbol : symbols) {
+      if (format == BITS_SOFT) {
+        int soft = lround(symbol * 64);
+        out->push_back(max(-127, min(127, soft)));
+        continue;
+      }
+      byte_ = (byte_ << 1) | (symbol > 0);
+      if (++count_ == 8) {
+        out->push_back(byte_);
+        byte_ = 0;
+        count_ = 0;
+      }
+    }
+  }
 };
 
-Decoder* makeDecoder(const Config& cfg) {
-  switch (cfg.mod) {
+/**
+ * Packs the decoder's output for writing: audio samples, or bits or KISS
+ * frames for FSK.
+ */
+void packOutput(const StereoAudio& audio, const Config& cfg,
+                BitPacker* bits, HdlcDeframer* hdlc, vector<char>* out) {
+  if (cfg.mod == MODULATION_FSK && cfg.kiss) {
+    vector<vector<uint8_t> > frames;
+    hdlc->process(audio.left, &frames);
+    out->clear();
+    for (const vector<uint8_t>& frame : frames) {
+      kissEncode(frame, out);
+    }
+  } else if (cfg.mod == MODULATION_FSK) {
+    bits->pack(audio.left, cfg.bitFormat, out);
+  } else {
+    packAudio(audio, cfg, out);
+  }
+}
+
+/**
+ * Writes the block latency percentiles and the static latency components.
+ */
+void printLatency(ostream& out, const LatencyHistogram& latency,
+                  const Config& cfg, Decoder* decoder) {
+  double blockMs = 1e3 * cfg.blockSize / kSampleBytes[cfg.inType] / cfg.inRate;
+  out << fixed << setprecision(3) << "latency: processing p50 " << latency.percentile(0.5) / 1e6
+      << " ms, p99 " << latency.percentile(0.99) / 1e6 << " ms, max "
+      << latency.max() / 1e6 << " ms over " << latency.count()
+      << " blocks; block buffering " << blockMs << " ms, filter delay "
+      << 1e3 * decoder->groupDelay() << " ms" << endl;
+  out.unsetf(ios::floatfield);
+}
+
+/**
+ * Creates a decoder for the given modulation. With a channel rate, the
+ * decoder is meant to be fed from another decoder's front end, and 0 is
+ * returned if the modulation doesn't support it.
+ */
+Decoder* makeDecoder(const Config& cfg, int mod, int channelRate = 0) {
+  switch (mod) {
   case MODULATION_AM:
-    return new AMDecoder(cfg.inRate, cfg.outRate, cfg.bandwidth);
+    return channelRate
+        ? new AMDecoder(cfg.inRate, cfg.outRate, cfg.bandwidth, channelRate)
+        : new AMDecoder(cfg.inRate, cfg.outRate, cfg.bandwidth);
   case MODULATION_WBFM:
-    return new WBFMDecoder(cfg.inRate, cfg.outRate);
+    return channelRate
+        ? new WBFMDecoder(cfg.inRate, cfg.outRate, channelRate)
+        : new WBFMDecoder(cfg.inRate, cfg.outRate);
   case MODULATION_NBFM:
-    return new NBFMDecoder(cfg.inRate, cfg.outRate, cfg.maxf);
+    return channelRate
+        ? new NBFMDecoder(cfg.inRate, cfg.outRate, cfg.maxf, channelRate)
+        : new NBFMDecoder(cfg.inRate, cfg.outRate, cfg.maxf);
+  case MODULATION_FSK: {
+    if (channelRate) {
+      return 0;
+    }
+    FSKDecoder* decoder = new FSKDecoder(cfg.inRate, cfg.baudRate, cfg.maxf);
+    decoder->setDescramble(cfg.descramble);
+    return decoder;
   }
+  }
+  return 0;
 }
 
 int main(int argc, char* argv[]) {
-  Config cfg { 1, 1, 10000, 10000, 65536, 1024000, 48000, 1, false };
+  Config cfg { 1, 1, 10000, 10000, 65536, 1024000, 48000, 1, false, false,
+               10, false, false, false, OVERRUN_NONE, 0, 0, "", "",
+               "", false, 0, SQUELCH_SILENCE, BURST_NONE, 100, 200, ".",
+               9600, BITS_HARD, false, false, {}, {}, 0, 0, 0, false, "", 0, "",
+               "" };
 
+  bool blockSizeSet = false;
   for (int i = 1; i < argc; ++i) {
     if (string("-mod") == argv[i]) {
       string modName = string(argv[++i]);
@@ -103,6 +305,7 @@ int main(int argc, char* argv[]) {
     } else if (string("-blocksize") == argv[i]) {
       cfg.blockSize = stoi(argv[++i]);
       cfg.blockSize -= (cfg.blockSize % 2);
+      blockSizeSet = true;
     } else if (string("-inrate") == argv[i]) {
       cfg.inRate = stoi(argv[++i]);
     } else if (string("-outrate") == argv[i]) {
@@ -111,60 +314,479 @@ int main(int argc, char* argv[]) {
       cfg.channels = stoi(argv[++i]);
     } else if (string("-squaredoutput") == argv[i]) {
       cfg.outSquared = true;
+    } else if (string("-stats") == argv[i]) {
+      cfg.stats = true;
+    } else if (string("-statsinterval") == argv[i]) {
+      cfg.statsInterval = stod(argv[++i]);
+    } else if (string("-latency") == argv[i]) {
+      cfg.latency = true;
+    } else if (string("-lowlatency") == argv[i]) {
+      cfg.lowLatency = true;
+    } else if (string("-overrun") == argv[i]) {
+      string policyName = string(argv[++i]);
+      int policy = -1;
+      for (int i = 0; overrunPolicies[i]; ++i) {
+        if (policyName == string(overrunPolicies[i])) {
+          policy = i;
+        }
+      }
+      if (policy == -1) {
+        cerr << "Unknown overrun policy: " << policyName << endl;
+        return 1;
+      }
+      cfg.overrunPolicy = policy;
+    } else if (string("-maxbacklog") == argv[i]) {
+      cfg.maxBacklog = stoll(argv[++i]);
+    } else if (string("-pipesize") == argv[i]) {
+      cfg.pipeSize = stoi(argv[++i]);
+    } else if (string("-perf") == argv[i]) {
+      cfg.stats = true;
+      cfg.perf = true;
+    } else if (string("-trace") == argv[i]) {
+      cfg.traceFile = argv[++i];
+    } else if (string("-squelch") == argv[i]) {
+      cfg.squelch = true;
+      cfg.squelchLevel = stof(argv[++i]);
+    } else if (string("-squelchmode") == argv[i]) {
+      string modeName = string(argv[++i]);
+      int mode = -1;
+      for (int i = 0; squelchModes[i]; ++i) {
+        if (modeName == string(squelchModes[i])) {
+          mode = i;
+        }
+      }
+      if (mode == -1) {
+        cerr << "Unknown squelch mode: " << modeName << endl;
+        return 1;
+      }
+      cfg.squelchMode = mode;
+    } else if (string("-burst") == argv[i]) {
+      string modeName = string(argv[++i]);
+      int mode = -1;
+      for (int i = 0; burstModes[i]; ++i) {
+        if (modeName == string(burstModes[i])) {
+          mode = i;
+        }
+      }
+      if (mode == -1) {
+        cerr << "Unknown burst mode: " << modeName << endl;
+        return 1;
+      }
+      cfg.burstMode = mode;
+    } else if (string("-burstpre") == argv[i]) {
+      cfg.burstPre = stoi(argv[++i]);
+    } else if (string("-burstpost") == argv[i]) {
+      cfg.burstPost = stoi(argv[++i]);
+    } else if (string("-burstdir") == argv[i]) {
+      cfg.burstDir = argv[++i];
+    } else if (string("-baud") == argv[i]) {
+      cfg.baudRate = stoi(argv[++i]);
+    } else if (string("-bits") == argv[i]) {
+      string formatName = string(argv[++i]);
+      int format = -1;
+      for (int i = 0; bitFormats[i]; ++i) {
+        if (formatName == string(bitFormats[i])) {
+          format = i;
+        }
+      }
+      if (format == -1) {
+        cerr << "Unknown bit format: " << formatName << endl;
+        return 1;
+      }
+      cfg.bitFormat = format;
+    } else if (string("-descramble") == argv[i]) {
+      cfg.descramble = true;
+    } else if (string("-kiss") == argv[i]) {
+      cfg.kiss = true;
+    } else if (string("-output") == argv[i]) {
+      string spec = string(argv[++i]);
+      size_t colon = spec.find(':');
+      if (colon == string::npos) {
+        cerr << "Output must be given as RATE:PATH: " << spec << endl;
+        return 1;
+      }
+      cfg.extraOutputs.push_back(
+          make_pair(stoi(spec.substr(0, colon)), spec.substr(colon + 1)));
+    } else if (string("-decode") == argv[i]) {
+      string spec = string(argv[++i]);
+      size_t colon = spec.find(':');
+      int mod = -1;
+      for (int i = 0; kMods[i]; ++i) {
+        if (spec.substr(0, colon) == string(kMods[i])) {
+          mod = i;
+        }
+      }
+      if (colon == string::npos || mod == -1) {
+        cerr << "Decoder must be given as MOD:PATH: " << spec << endl;
+        return 1;
+      }
+      cfg.extraDecoders.push_back(make_pair(mod, spec.substr(colon + 1)));
+    } else if (string("-freqcorr") == argv[i]) {
+      cfg.freqCorr = stod(argv[++i]);
+    } else if (string("-ppm") == argv[i]) {
+      cfg.ppm = stod(argv[++i]);
+    } else if (string("-centerfreq") == argv[i]) {
+      cfg.centerFreq = stod(argv[++i]);
+    } else if (string("-doppler") == argv[i]) {
+      cfg.dopplerFile = argv[++i];
+    } else if (string("-dopplerstart") == argv[i]) {
+      cfg.dopplerStart = stod(argv[++i]);
+    } else if (string("-iqcorrect") == argv[i]) {
+      cfg.iqCorrect = true;
+    } else if (string("-graph") == argv[i]) {
+      cfg.graph = argv[++i];
+    } else if (string("-graphfile") == argv[i]) {
+      cfg.graphFile = argv[++i];
+    } else if (string("-metricsfile") == argv[i]) {
+      cfg.metricsFile = argv[++i];
+    } else if (string("-metricssocket") == argv[i]) {
+      cfg.metricsSocket = argv[++i];
     } else {
       cerr << "Unknown flag: " << argv[i] << endl;
       return 1;
     }
   }
 
-  char outBlock[4];
+  if (cfg.kiss && (cfg.mod != MODULATION_FSK || cfg.burstMode != BURST_NONE)) {
+    cerr << "-kiss needs -mod FSK and can't be used with -burst" << endl;
+    return 1;
+  }
+
+  if ((!cfg.graph.empty() || !cfg.graphFile.empty())
+      && cfg.mod == MODULATION_FSK) {
+    cerr << "-graph and -graphfile can't be used with -mod FSK" << endl;
+    return 1;
+  }
+
+  // Stereo decoding is the only thing degrade can turn off.
+  if (cfg.overrunPolicy == OVERRUN_DEGRADE
+      && (cfg.mod != MODULATION_WBFM || cfg.channels != 2)) {
+    cerr << "-overrun degrade needs -mod WBFM and -channels 2" << endl;
+    return 1;
+  }
+
+  if (cfg.ppm != 0 && cfg.centerFreq == 0) {
+    cerr << "-ppm needs -centerfreq" << endl;
+    return 1;
+  }
+
+  if (cfg.lowLatency && !blockSizeSet) {
+    cfg.blockSize = kSampleBytes[cfg.inType] * (cfg.inRate / kLowLatencyBlocks);
+  }
+
   char* buffer = new char[cfg.blockSize];
-  Decoder* decoder = makeDecoder(cfg);
+  // A tuner that is tuned too high shows the signals too low; shift them
+  // back up.
+  double shift = cfg.freqCorr + cfg.centerFreq * cfg.ppm / 1e6;
+  DopplerTable doppler;
+  if (!cfg.dopplerFile.empty() && !doppler.load(cfg.dopplerFile)) {
+    cerr << "Could not load the Doppler table: " << doppler.error() << endl;
+    return 1;
+  }
+  unique_ptr<NCO> nco;
+  if (shift != 0 || !doppler.empty()) {
+    nco.reset(new NCO(cfg.inRate, shift));
+  }
+  unique_ptr<IQCorrector> corrector;
+  if (cfg.iqCorrect) {
+    corrector.reset(new IQCorrector());
+  }
+  Decoder* decoder;
+  if (!cfg.graph.empty() || !cfg.graphFile.empty()) {
+    Flowgraph* graph = new Flowgraph(cfg.inRate, cfg.outRate);
+    if (!(cfg.graphFile.empty() ? graph->build(cfg.graph)
+                                : graph->load(cfg.graphFile))) {
+      cerr << "Could not build the flowgraph: " << graph->error() << endl;
+      return 1;
+    }
+    if (cfg.stats) {
+      cerr << "flowgraph: " << graph->stageCount() << " stages, "
+           << graph->elidedCount() << " elided, " << graph->mergedCount()
+           << " merged, " << graph->bufferCount() << " buffers" << endl;
+    }
+    decoder = graph;
+  } else {
+    decoder = makeDecoder(cfg, cfg.mod);
+  }
+  if (cfg.squelch) {
+    decoder->setSquelch(cfg.squelchLevel, kSquelchHysteresis);
+  }
+  if (cfg.lowLatency) {
+    decoder->setMinimumPhase();
+  }
+  vector<unique_ptr<ofstream> > extraFiles;
+  for (const pair<int, string>& output : cfg.extraOutputs) {
+    if (decoder->addOutput(output.first) < 0) {
+      cerr << "Extra outputs are not supported for " << kMods[cfg.mod] << endl;
+      return 1;
+    }
+    extraFiles.emplace_back(new ofstream(output.second.c_str(), ios::binary));
+    if (!*extraFiles.back()) {
+      cerr << "Could not open output: " << output.second << endl;
+      return 1;
+    }
+  }
+  // The extra decoders are fed from the main decoder's front end.
+  FrontEnd* frontEnd = decoder->frontEnd();
+  vector<unique_ptr<Decoder> > extraDecoders;
+  vector<unique_ptr<ofstream> > decoderFiles;
+  for (const pair<int, string>& extra : cfg.extraDecoders) {
+    Decoder* extraDecoder =
+        frontEnd ? makeDecoder(cfg, extra.first, frontEnd->outRate()) : 0;
+    if (!extraDecoder) {
+      cerr << kMods[extra.first] << " can't share the front end of "
+           << kMods[cfg.mod] << endl;
+      return 1;
+    }
+    if (cfg.lowLatency) {
+      extraDecoder->setMinimumPhase();
+    }
+    extraDecoders.emplace_back(extraDecoder);
+    decoderFiles.emplace_back(new ofstream(extra.second.c_str(), ios::binary));
+    if (!*decoderFiles.back()) {
+      cerr << "Could not open output: " << extra.second << endl;
+      return 1;
+    }
+  }
   StereoAudio audio;
+  vector<char> outBlock;
+  StageStats stats;
+  LatencyHistogram latency;
+  int64_t inSamples = 0;
+  int64_t lastReport = monotonicNanos();
+  unique_ptr<PerfCounters> perf;
+  if (cfg.perf) {
+    perf.reset(new PerfCounters());
+    if (perf->available()) {
+      stats.setPerfCounters(perf.get());
+    } else {
+      cerr << "Hardware counters unavailable: " << perf->error() << endl;
+    }
+  }
+  unique_ptr<TraceWriter> trace;
+  if (!cfg.traceFile.empty()) {
+    trace.reset(new TraceWriter(cfg.traceFile));
+    if (!trace->ok()) {
+      cerr << "Could not create trace file: " << cfg.traceFile << endl;
+      return 1;
+    }
+    stats.setTrace(trace.get());
+  }
+  Metrics metrics;
+  unique_ptr<MetricsExporter> exporter;
+  if (!cfg.metricsFile.empty() || !cfg.metricsSocket.empty()) {
+    exporter.reset(new MetricsExporter(metrics, cfg.metricsFile,
+                                       cfg.metricsSocket, cfg.statsInterval));
+    if (!exporter->ok()) {
+      cerr << "Could not export metrics: " << exporter->error() << endl;
+      return 1;
+    }
+  }
+  if (cfg.stats || trace || exporter) {
+    StageStats::setCurrent(&stats);
+  }
+  unique_ptr<BurstSink> burstSink;
+  switch (cfg.burstMode) {
+  case BURST_RAW:
+    burstSink.reset(new RawBurstWriter(cout));
+    break;
+  case BURST_FRAMED:
+    burstSink.reset(new FramedBurstWriter(cout));
+    break;
+  case BURST_FILES:
+    burstSink.reset(new FileBurstWriter(cfg.burstDir));
+    break;
+  }
+  // FSK bits are gated by the byte.
+  int frameSize = 2 * cfg.channels;
+  int frameRate = cfg.outRate;
+  if (cfg.mod == MODULATION_FSK) {
+    frameSize = 1;
+    frameRate = cfg.bitFormat == BITS_SOFT ? cfg.baudRate : cfg.baudRate / 8;
+  }
+  unique_ptr<BurstGate> gate;
+  if (burstSink) {
+    gate.reset(new BurstGate(burstSink.get(), frameSize, frameRate,
+                             (int64_t) cfg.burstPre * frameRate / 1000,
+                             (int64_t) cfg.burstPost * frameRate / 1000));
+  }
+  BitPacker bits;
+  HdlcDeframer hdlc;
+  OverrunMonitor overrun(0, cfg.maxBacklog, cfg.blockSize);
+  if (cfg.pipeSize && !overrun.setPipeSize(cfg.pipeSize)) {
+    cerr << "Could not set the input pipe size" << endl;
+  }
+  int64_t blockNanos = 1e9 * cfg.blockSize / kSampleBytes[cfg.inType] / cfg.inRate;
+  int64_t processNanos = 0;
+  int64_t block = 0;
 
   while (!cin.eof()) {
+    int64_t readStart = monotonicNanos();
     cin.read(buffer, cfg.blockSize);
+    int64_t readTime = monotonicNanos();
     int read = cin.gcount();
+    stats.setBlock(block++);
+    if (trace) {
+      // Time spent waiting for input shows up as gaps between the blocks.
+      trace->record("read", readStart, readTime, stats.block(),
+                    read / kSampleBytes[cfg.inType]);
+    }
+
+    bool wasBehind = overrun.behind();
+    bool behind = overrun.update(processNanos, blockNanos);
+    if (behind != wasBehind && cfg.overrunPolicy != OVERRUN_NONE) {
+      if (behind) {
+        cerr << "Falling behind the input: " << overrun.counters().backlog
+             << " bytes waiting" << endl;
+      } else {
+        cerr << "Caught up with the input" << endl;
+      }
+    }
+    if (behind && cfg.overrunPolicy == OVERRUN_DROP) {
+      overrun.dropped();
+      // The dropped samples still advance the Doppler time base.
+      inSamples += read / kSampleBytes[cfg.inType];
+      if (exporter) {
+        metrics.add(METRIC_SAMPLES_IN, read / kSampleBytes[cfg.inType]);
+        metrics.set(METRIC_DROPPED_BLOCKS, overrun.counters().droppedBlocks);
+      }
+      processNanos = 0;
+      continue;
+    }
+
     bool use_stereo;
-    if (cfg.channels == 2) {
+    if (cfg.channels == 2 && !(behind && cfg.overrunPolicy == OVERRUN_DEGRADE)) {
       use_stereo = true;
     }
     else {
       use_stereo = false;
     }
 
-    if (cfg.inType == INPUT_TYPE_U8) {
-      audio = decoder->decode(samplesFromUint8(reinterpret_cast<uint8_t*>(buffer), read), use_stereo);
-    }
-    else if (cfg.inType == INPUT_TYPE_I16) {
-      audio = decoder->decode(samplesFromInt16(reinterpret_cast<int16_t*>(buffer), read / 2), use_stereo);
+    if (!doppler.empty()) {
+      // Follows the offset at the middle of the block.
+      double time = cfg.dopplerStart
+          + (inSamples + read / kSampleBytes[cfg.inType] / 2.0) / cfg.inRate;
+      nco->setFrequency(shift - doppler.offsetAt(time));
     }
 
-    for (int i = 0; i < audio.left.size(); ++i) {
-      int left = audio.left[i] * 32767;
+    Samples samples;
+    {
+      StageTimer timer(STAGE_CONVERT, read / kSampleBytes[cfg.inType]);
+      if (cfg.inType == INPUT_TYPE_U8) {
+        samples = samplesFromUint8(reinterpret_cast<uint8_t*>(buffer), read,
+                                   nco.get(), corrector.get());
+      }
+      else if (cfg.inType == INPUT_TYPE_I16) {
+        samples = samplesFromInt16(reinterpret_cast<int16_t*>(buffer),
+                                   read / 2, nco.get(), corrector.get());
+      }
+      else if (cfg.inType == INPUT_TYPE_CF32) {
+        samples = samplesFromFloat32(reinterpret_cast<float*>(buffer),
+                                     read / 4, nco.get(), corrector.get());
+      }
+    }
+    inSamples += read / kSampleBytes[cfg.inType];
+    vector<StereoAudio> extraAudio;
+    if (extraDecoders.empty()) {
+      audio = decoder->decode(samples, use_stereo);
+    } else {
+      SamplesIQ channel(frontEnd->process(samples));
+      bool squelched = frontEnd->squelched();
+      audio = decoder->decodeChannel(channel, squelched, use_stereo);
+      for (unique_ptr<Decoder>& extraDecoder : extraDecoders) {
+        extraAudio.push_back(
+            extraDecoder->decodeChannel(channel, squelched, use_stereo));
+      }
+    }
 
-      // make output square like for multimon-ng
-      if (cfg.outSquared) {
-        if (left > 0) left = 32767;
-        if (left < 0) left = -32767;
+    // FSK writes bits and bytes rather than audio frames.
+    int framesOut = 0;
+    if (gate) {
+      StageTimer timer(STAGE_OUTPUT, audio.left.size());
+      packOutput(audio, cfg, &bits, &hdlc, &outBlock);
+      int written =
+          gate->process(outBlock.data(), outBlock.size(), audio.carrier);
+      if (cfg.mod != MODULATION_FSK) {
+        framesOut = written;
+      }
+    } else if (!(cfg.squelchMode == SQUELCH_SKIP && decoder->squelched())) {
+      StageTimer timer(STAGE_OUTPUT, audio.left.size());
+      packOutput(audio, cfg, &bits, &hdlc, &outBlock);
+      cout.write(outBlock.data(), outBlock.size());
+      if (cfg.mod != MODULATION_FSK) {
+        framesOut = audio.left.size();
+      }
+    }
+    if (!(cfg.squelchMode == SQUELCH_SKIP && decoder->squelched())) {
+      for (int i = 0; i < extraFiles.size(); ++i) {
+        StereoAudio extra = decoder->extraOutput(i);
+        StageTimer timer(STAGE_OUTPUT, extra.left.size());
+        packAudio(extra, cfg, &outBlock);
+        extraFiles[i]->write(outBlock.data(), outBlock.size());
+        if (cfg.latency || cfg.lowLatency) {
+          extraFiles[i]->flush();
+        }
       }
+      for (int i = 0; i < extraAudio.size(); ++i) {
+        StageTimer timer(STAGE_OUTPUT, extraAudio[i].left.size());
+        packAudio(extraAudio[i], cfg, &outBlock);
+        decoderFiles[i]->write(outBlock.data(), outBlock.size());
+        if (cfg.latency || cfg.lowLatency) {
+          decoderFiles[i]->flush();
+        }
+      }
+    }
+    if (cfg.latency || cfg.lowLatency) {
+      cout.flush();
+    }
+    if (cfg.latency) {
+      latency.add(monotonicNanos() - readTime);
+    }
+    processNanos = monotonicNanos() - readTime;
 
-      if (left > 32767) left = 32767;
-      if (left < -32767) left = -32767;
-      outBlock[0] = left & 0xff;
-      outBlock[1] = (left >> 8) & 0xff;
+    if (exporter) {
+      const OverrunCounters& counters = overrun.counters();
+      metrics.add(METRIC_SAMPLES_IN, read / kSampleBytes[cfg.inType]);
+      metrics.add(METRIC_SAMPLES_OUT, framesOut);
+      metrics.set(METRIC_BLOCKS, counters.blocks);
+      metrics.add(METRIC_CARRIER_BLOCKS, audio.carrier ? 1 : 0);
+      metrics.add(METRIC_STEREO_BLOCKS, audio.inStereo ? 1 : 0);
+      metrics.set(METRIC_LATE_BLOCKS, counters.lateBlocks);
+      metrics.set(METRIC_BACKLOG, counters.backlog);
+      metrics.setStages(stats);
+    }
 
-      if (cfg.channels == 2) {
-        int right = audio.right[i] * 32767;
-        if (right > 32767) right = 32767;
-        if (right < -32767) right = -32767;
-        outBlock[2] = right & 0xff;
-        outBlock[3] = (right >> 8) & 0xff;
-        cout.write(outBlock, 4);
+    if ((cfg.stats || cfg.latency)
+        && monotonicNanos() - lastReport >= cfg.statsInterval * 1e9) {
+      if (cfg.stats) {
+        stats.print(cerr, (double) inSamples / cfg.inRate);
+        overrun.print(cerr);
       }
-      else {
-        cout.write(outBlock, 2);
+      if (cfg.latency) {
+        printLatency(cerr, latency, cfg, decoder);
       }
+      lastReport = monotonicNanos();
     }
   }
+
+  if (gate) {
+    gate->flush();
+  }
+  if (cfg.stats) {
+    stats.print(cerr, (double) inSamples / cfg.inRate);
+  }
+  if (cfg.stats || cfg.overrunPolicy != OVERRUN_NONE) {
+    overrun.print(cerr);
+  }
+  if (cfg.stats && cfg.kiss) {
+    cerr << "hdlc: " << hdlc.frames() << " frames, " << hdlc.badFrames()
+         << " with a bad checksum" << endl;
+  }
+  if (cfg.latency) {
+    printLatency(cerr, latency, cfg, decoder);
+  }
+  if (trace && trace->dropped()) {
+    cerr << "Trace buffer overflowed: " << trace->dropped()
+         << " events dropped" << endl;
+  }
 }
@@ -0,0 +1,90 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+/**
+ * Tables of a signal's frequency offset over time, used to follow the
+ * Doppler shift of satellite downlinks.
+ */
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "doppler.h"
+
+using namespace std;
+
+namespace radioreceiver {
+
+bool DopplerTable::load(const string& path) {
+  ifstream in(path.c_str());
+  if (!in) {
+    error_ = "could not open " + path;
+    return false;
+  }
+  string line;
+  for (int lineNum = 1; getline(in, line); ++lineNum) {
+    replace(line.begin(), line.end(), ',', ' ');
+    istringstream fields(line);
+    double time;
+    double offset;
+    if (!(fields >> time)) {
+      fields.clear();
+      char first;
+      if (!(fields >> first) || first == '#') {
+        continue;
+      }
+    } else if (fields >> offset
+               && (times_.empty() || time > times_.back())) {
+      add(time, offset);
+      continue;
+    }
+    ostringstream why;
+    why << path << ":" << lineNum << ": expected a time after the previous "
+        << "one and an offset";
+    error_ = why.str();
+    return false;
+  }
+  if (times_.empty()) {
+    error_ = path + " has no points";
+    return false;
+  }
+  error_.clear();
+  return true;
+}
+
+void DopplerTable::add(double time, double offset) {
+  times_.push_back(time);
+  offsets_.push_back(offset);
+}
+
+double DopplerTable::offsetAt(double time) const {
+  if (times_.empty()) {
+    return 0;
+  }
+  int next = upper_bound(times_.begin(), times_.end(), time) - times_.begin();
+  if (next == 0) {
+    return offsets_.front();
+  }
+  if (next == times_.size()) {
+    return offsets_.back();
+  }
+  double frac = (time - times_[next - 1]) / (times_[next] - times_[next - 1]);
+  return offsets_[next - 1] + frac * (offsets_[next] - offsets_[next - 1]);
+}
+
+}  // namespace radioreceiver
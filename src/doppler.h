@@ -0,0 +1,79 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+/**
+ * Tables of a signal's frequency offset over time, used to follow the
+ * Doppler shift of satellite downlinks.
+ */
+
+#ifndef DOPPLER_H_
+#define DOPPLER_H_
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace radioreceiver {
+
+/**
+ * The frequency offset of a signal over time, such as the Doppler shift
+ * of a satellite's downlink predicted for a pass, interpolated linearly
+ * between the points of the table.
+ */
+class DopplerTable {
+  vector<double> times_;
+  vector<double> offsets_;
+  string error_;
+
+ public:
+  /**
+   * Loads the points of the table from a text file with a time in seconds
+   * and an offset in Hz on each line, separated by spaces, tabs or a
+   * comma. Empty lines and lines that start with '#' are skipped.
+   * @param path The file's path.
+   * @return Whether the file could be read; error() tells why not.
+   */
+  bool load(const string& path);
+
+  /**
+   * Adds a point to the end of the table.
+   * @param time The point's time in seconds, after the previous point's.
+   * @param offset The signal's frequency offset at that time, in Hz.
+   */
+  void add(double time, double offset);
+
+  /**
+   * Returns the signal's frequency offset at the given time, which is
+   * that of the first or last point outside the table.
+   * @param time The time in seconds.
+   * @return The offset in Hz.
+   */
+  double offsetAt(double time) const;
+
+  /**
+   * Tells whether the table has no points.
+   */
+  bool empty() const { return times_.empty(); }
+
+  /**
+   * Returns why the last load() failed.
+   */
+  const string& error() const { return error_; }
+};
+
+}  // namespace radioreceiver
+
+#endif  // DOPPLER_H_
@@ -19,13 +19,15 @@
 #include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <complex>
 #include <cstring>
+#include <functional>
 #include <memory>
-#include <numeric>
 #include <stdint.h>
 #include <vector>
 
 #include "dsp.h"
+#include "stats.h"
 
 using namespace std;
 
@@ -33,7 +35,22 @@ namespace radioreceiver {
 
 const double kPi = 3.141592653589793238;
 const double k2Pi = 2 * kPi;
-const double kPi2 = kPi / 2;
+
+// The number of channel filter outputs skipped between the ones computed
+// to estimate the power of a squelched channel.
+const int kSquelchStride = 16;
+
+// The number of I/Q pairs the IQCorrector's estimates average over, about
+// a second of a typical RTL-SDR stream.
+const double kIQAverageSamples = 1 << 20;
+
+// The number of I/Q pairs the IQCorrector collects before each update, so
+// that the estimates don't depend on the block size.
+const int kIQUpdateSamples = 1 << 15;
+
+// The longest filter the spec-driven designers try before giving up on a
+// specification, such as an attenuation beyond what floats can hold.
+const int kMaxDesignLength = 4095;
 
 vector<float> getLowPassFIRCoeffs(int sampleRate, float halfAmplFreq,
                                   int length) {
@@ -60,7 +77,576 @@ vector<float> getLowPassFIRCoeffs(int sampleRate, float halfAmplFreq,
   return coefficients;
 }
 
-Samples samplesFromUint8(uint8_t* buffer, int length) {
+/**
+ * Returns the largest weighted deviation of a symmetric low-pass filter's
+ * amplitude response from 1 in the passband and 0 in the stopband.
+ * @param coefficients The filter's coefficients, an odd number of them.
+ * @param passEdge The passband edge, in radians per sample.
+ * @param stopEdge The stopband edge, in radians per sample.
+ * @param stopWeight The weight of the stopband's deviation.
+ * @return The deviation.
+ */
+static double lowPassDeviation(const vector<float>& coefficients,
+                               double passEdge, double stopEdge,
+                               double stopWeight) {
+  int center = coefficients.size() / 2;
+  int points = 16 * coefficients.size();
+  double worst = 0;
+  for (int i = 0; i <= points; ++i) {
+    double w = kPi * i / points;
+    if (w > passEdge && w < stopEdge) {
+      continue;
+    }
+    // cos(w * n) by the Chebyshev recurrence.
+    double c = cos(w);
+    double prev = 1;
+    double cur = c;
+    double amplitude = coefficients[center];
+    for (int n = 1; n <= center; ++n) {
+      amplitude += 2 * coefficients[center + n] * cur;
+      double next = 2 * c * cur - prev;
+      prev = cur;
+      cur = next;
+    }
+    worst = max(worst, w <= passEdge ? fabs(amplitude - 1)
+                                     : stopWeight * fabs(amplitude));
+  }
+  return worst;
+}
+
+/**
+ * Finds the shortest odd length at which a design meets its specification,
+ * starting from an estimate: the length is moved in growing steps until
+ * the specification is met on one side and not on the other, and then the
+ * interval is halved.
+ * @param estimate The first length to try.
+ * @param design Designs the filter of a given length.
+ * @param meets Tells whether a filter meets the specification.
+ * @return The shortest filter that meets it, or the longest tried if none
+ *     up to kMaxDesignLength does.
+ */
+static vector<float> shortestDesign(
+    int estimate, const function<vector<float>(int)>& design,
+    const function<bool(const vector<float>&)>& meets) {
+  int length = min(kMaxDesignLength, max(3, estimate + (estimate + 1) % 2));
+  vector<float> best = design(length);
+  int pass = length;
+  int fail = 1;
+  if (meets(best)) {
+    for (int step = 2; pass > 3; step *= 2) {
+      int len = max(3, pass - step);
+      vector<float> shorter = design(len);
+      if (!meets(shorter)) {
+        fail = len;
+        break;
+      }
+      pass = len;
+      best.swap(shorter);
+    }
+  } else {
+    fail = length;
+    for (int step = 2; ; step *= 2) {
+      if (fail == kMaxDesignLength) {
+        return best;
+      }
+      int len = min(kMaxDesignLength, fail + step);
+      vector<float> longer = design(len);
+      best.swap(longer);
+      if (meets(best)) {
+        pass = len;
+        break;
+      }
+      fail = len;
+    }
+  }
+  while (pass - fail > 2) {
+    int len = fail + (pass - fail) / 4 * 2;
+    vector<float> middle = design(len);
+    if (meets(middle)) {
+      pass = len;
+      best.swap(middle);
+    } else {
+      fail = len;
+    }
+  }
+  return best;
+}
+
+/**
+ * Converts a passband ripple in dB, peak to peak, into a deviation.
+ */
+static double rippleDeviation(float ripple) {
+  double gain = pow(10, ripple / 20);
+  return (gain - 1) / (gain + 1);
+}
+
+/**
+ * Computes the zeroth-order modified Bessel function of the first kind,
+ * which shapes the Kaiser window.
+ */
+static double besselI0(double x) {
+  double sum = 1;
+  double term = 1;
+  for (int k = 1; term > 1e-12 * sum; ++k) {
+    term *= (x / (2 * k)) * (x / (2 * k));
+    sum += term;
+  }
+  return sum;
+}
+
+/**
+ * Designs a Kaiser-windowed sinc low-pass filter of the given length. It is
+ * not normalized to a gain of 1 at DC, which would move the passband's
+ * ripple off center.
+ */
+static vector<float> kaiserFilter(int length, double cutoff, double beta) {
+  int center = length / 2;
+  double norm = besselI0(beta);
+  vector<float> coefficients(length);
+  for (int i = 0; i < length; ++i) {
+    double pos = (double) (i - center) / center;
+    double window = besselI0(beta * sqrt(max(0.0, 1 - pos * pos))) / norm;
+    double sinc = i == center
+        ? cutoff / kPi : sin(cutoff * (i - center)) / (kPi * (i - center));
+    coefficients[i] = sinc * window;
+  }
+  return coefficients;
+}
+
+vector<float> getKaiserFIRCoeffs(int sampleRate, float passFreq,
+                                 float stopFreq, float attenuation) {
+  if (stopFreq >= sampleRate / 2.0) {
+    return vector<float>(1, 1);
+  }
+  double passEdge = k2Pi * passFreq / sampleRate;
+  double stopEdge = k2Pi * stopFreq / sampleRate;
+  double beta = attenuation > 50 ? 0.1102 * (attenuation - 8.7)
+      : attenuation > 21 ? 0.5842 * pow(attenuation - 21, 0.4)
+                           + 0.07886 * (attenuation - 21)
+      : 0;
+  double deviation = pow(10, -attenuation / 20);
+  // Kaiser's estimate of the length is close; the search corrects it.
+  int length = (int) ceil((attenuation - 7.95)
+                          / (2.285 * (stopEdge - passEdge))) + 1;
+  return shortestDesign(
+      length,
+      [&](int len) {
+        return kaiserFilter(len, (passEdge + stopEdge) / 2, beta);
+      },
+      [&](const vector<float>& coefs) {
+        return lowPassDeviation(coefs, passEdge, stopEdge, 1) <= deviation;
+      });
+}
+
+/**
+ * Designs an equiripple low-pass filter of the given odd length with the
+ * Parks-McClellan algorithm: the Remez exchange finds the amplitude
+ * response, a sum of cosines, whose weighted error alternates in sign
+ * with equal magnitude at as many frequencies as it has coefficients plus
+ * one, and the coefficients are then read from that response.
+ * @param length The filter's length.
+ * @param passEdge The passband edge, in radians per sample.
+ * @param stopEdge The stopband edge, in radians per sample.
+ * @param stopWeight The weight of the stopband's error relative to the
+ *     passband's.
+ * @return The filter's coefficients.
+ */
+static vector<float> remezLowPass(int length, double passEdge,
+                                  double stopEdge, double stopWeight) {
+  int center = length / 2;
+  int extremals = center + 2;
+
+  // A dense grid of both bands, with points at the band edges.
+  int points = 16 * (center + 1);
+  double bandwidth = passEdge + (kPi - stopEdge);
+  // A passband that is just DC is a single point.
+  int passPoints = passEdge > 0
+      ? max(2, (int) round(points * passEdge / bandwidth)) : 1;
+  int stopPoints = max(2, points - passPoints);
+  vector<double> grid;
+  vector<double> desired;
+  vector<double> weight;
+  for (int i = 0; i < passPoints; ++i) {
+    grid.push_back(passPoints > 1 ? passEdge * i / (passPoints - 1) : 0);
+    desired.push_back(1);
+    weight.push_back(1);
+  }
+  for (int i = 0; i < stopPoints; ++i) {
+    grid.push_back(stopEdge + (kPi - stopEdge) * i / (stopPoints - 1));
+    desired.push_back(0);
+    weight.push_back(stopWeight);
+  }
+  int gridSize = grid.size();
+  vector<double> gridCos(gridSize);
+  for (int i = 0; i < gridSize; ++i) {
+    gridCos[i] = cos(grid[i]);
+  }
+
+  vector<int> ext(extremals);
+  for (int k = 0; k < extremals; ++k) {
+    ext[k] = (int) ((double) k * (gridSize - 1) / (extremals - 1));
+  }
+  vector<double> x(extremals);
+  vector<double> y(extremals);
+  vector<double> bary(extremals);
+  // Evaluates the amplitude response at cos(w) through the first
+  // extremals - 1 points, by barycentric Lagrange interpolation.
+  auto amplitude = [&](double xw) {
+    double num = 0;
+    double den = 0;
+    for (int k = 0; k < extremals - 1; ++k) {
+      double diff = xw - x[k];
+      if (fabs(diff) < 1e-15) {
+        return y[k];
+      }
+      double term = bary[k] / diff;
+      num += term * y[k];
+      den += term;
+    }
+    return num / den;
+  };
+
+  vector<double> error(gridSize);
+  for (int iter = 0; iter < 100; ++iter) {
+    for (int k = 0; k < extremals; ++k) {
+      x[k] = gridCos[ext[k]];
+    }
+    // The deviation that the response through all the points reaches.
+    double num = 0;
+    double den = 0;
+    for (int k = 0; k < extremals; ++k) {
+      double b = 1;
+      for (int j = 0; j < extremals; ++j) {
+        if (j != k) {
+          b *= 2 * (x[k] - x[j]);
+        }
+      }
+      b = 1 / b;
+      num += b * desired[ext[k]];
+      den += (k % 2 ? -b : b) / weight[ext[k]];
+    }
+    double delta = num / den;
+    for (int k = 0; k < extremals; ++k) {
+      y[k] = desired[ext[k]] - (k % 2 ? -delta : delta) / weight[ext[k]];
+    }
+    for (int k = 0; k < extremals - 1; ++k) {
+      double b = 1;
+      for (int j = 0; j < extremals - 1; ++j) {
+        if (j != k) {
+          b *= 2 * (x[k] - x[j]);
+        }
+      }
+      bary[k] = 1 / b;
+    }
+    for (int i = 0; i < gridSize; ++i) {
+      error[i] = weight[i] * (amplitude(gridCos[i]) - desired[i]);
+    }
+
+    // The new extremal frequencies: the local extrema of the error in each
+    // band, with runs of the same sign reduced to their largest.
+    vector<int> found;
+    for (int i = 0; i < gridSize; ++i) {
+      bool first = i == 0 || i == passPoints;
+      bool last = i == passPoints - 1 || i == gridSize - 1;
+      double e = error[i];
+      if ((e > 0 && (first || e >= error[i - 1])
+           && (last || e >= error[i + 1]))
+          || (e < 0 && (first || e <= error[i - 1])
+              && (last || e <= error[i + 1]))) {
+        if (!found.empty() && (error[found.back()] > 0) == (e > 0)) {
+          if (fabs(e) > fabs(error[found.back()])) {
+            found.back() = i;
+          }
+        } else {
+          found.push_back(i);
+        }
+      }
+    }
+    // Drops the smallest extrema while there are too many, keeping the
+    // signs alternating.
+    while (found.size() > extremals) {
+      int smallest = 0;
+      for (int k = 1; k < found.size(); ++k) {
+        if (fabs(error[found[k]]) < fabs(error[found[smallest]])) {
+          smallest = k;
+        }
+      }
+      if (found.size() == extremals + 1 || smallest == 0
+          || smallest == found.size() - 1) {
+        if (found.size() == extremals + 1) {
+          smallest = fabs(error[found.front()]) < fabs(error[found.back()])
+              ? 0 : found.size() - 1;
+        }
+        found.erase(found.begin() + smallest);
+      } else {
+        // Its neighbours now have the same sign; keep the larger one.
+        int drop = fabs(error[found[smallest - 1]])
+            < fabs(error[found[smallest + 1]]) ? smallest - 1 : smallest + 1;
+        found.erase(found.begin() + max(smallest, drop));
+        found.erase(found.begin() + min(smallest, drop));
+      }
+    }
+    if (found.size() < extremals) {
+      break;
+    }
+    double worst = 0;
+    for (int i : found) {
+      worst = max(worst, fabs(error[i]));
+    }
+    bool converged = worst - fabs(delta) <= 1e-6 * worst;
+    ext = found;
+    if (converged) {
+      break;
+    }
+  }
+
+  // The coefficients are the inverse DFT of the response sampled at the
+  // filter's length.
+  vector<double> response(center + 1);
+  for (int k = 0; k <= center; ++k) {
+    response[k] = amplitude(cos(k2Pi * k / length));
+  }
+  vector<float> coefficients(length);
+  for (int n = 0; n <= center; ++n) {
+    double sum = response[0];
+    for (int k = 1; k <= center; ++k) {
+      sum += 2 * response[k] * cos(k2Pi * k * n / length);
+    }
+    coefficients[center + n] = coefficients[center - n] = sum / length;
+  }
+  return coefficients;
+}
+
+vector<float> getEquirippleFIRCoeffs(int sampleRate, float passFreq,
+                                     float stopFreq, float attenuation,
+                                     float ripple) {
+  if (stopFreq >= sampleRate / 2.0) {
+    return vector<float>(1, 1);
+  }
+  double passEdge = k2Pi * passFreq / sampleRate;
+  double stopEdge = k2Pi * stopFreq / sampleRate;
+  double passDeviation = rippleDeviation(ripple);
+  double stopDeviation = pow(10, -attenuation / 20);
+  double stopWeight = passDeviation / stopDeviation;
+  // Herrmann's estimate of the length; the search corrects it.
+  double transition = (stopFreq - passFreq) / sampleRate;
+  int length = (int) ceil((-20 * log10(sqrt(passDeviation * stopDeviation))
+                           - 13) / (14.6 * transition)) + 1;
+  return shortestDesign(
+      length,
+      [&](int len) {
+        return remezLowPass(len, passEdge, stopEdge, stopWeight);
+      },
+      [&](const vector<float>& coefs) {
+        return lowPassDeviation(coefs, passEdge, stopEdge, stopWeight)
+            <= passDeviation;
+      });
+}
+
+/**
+ * Computes an in-place radix-2 discrete Fourier transform, or its inverse
+ * without the 1/N scaling.
+ * @param data The values to transform. Its length must be a power of 2.
+ * @param inverse Whether to compute the inverse transform.
+ */
+static void fft(vector<complex<double> >& data, bool inverse) {
+  int n = data.size();
+  for (int i = 1, j = 0; i < n; ++i) {
+    int bit = n >> 1;
+    for (; j & bit; bit >>= 1) {
+      j ^= bit;
+    }
+    j ^= bit;
+    if (i < j) {
+      swap(data[i], data[j]);
+    }
+  }
+  for (int len = 2; len <= n; len <<= 1) {
+    double angle = (inverse ? k2Pi : -k2Pi) / len;
+    complex<double> step(cos(angle), sin(angle));
+    for (int start = 0; start < n; start += len) {
+      complex<double> w(1);
+      for (int k = 0; k < len / 2; ++k, w *= step) {
+        complex<double> a = data[start + k];
+        complex<double> b = data[start + k + len / 2] * w;
+        data[start + k] = a + b;
+        data[start + k + len / 2] = a - b;
+      }
+    }
+  }
+}
+
+vector<float> getMinimumPhaseFIRCoeffs(const vector<float>& coefficients) {
+  // Homomorphic method: fold the real cepstrum of the magnitude response
+  // onto positive quefrencies, which turns it into the cepstrum of the
+  // minimum-phase filter. The transform is much longer than the kernel
+  // so that the cepstrum of the deep stopband doesn't alias.
+  int length = coefficients.size();
+  int n = 1;
+  while (n < 32 * length) {
+    n <<= 1;
+  }
+  vector<complex<double> > spectrum(n);
+  for (int i = 0; i < length; ++i) {
+    spectrum[i] = coefficients[i];
+  }
+  fft(spectrum, false);
+  for (int i = 0; i < n; ++i) {
+    spectrum[i] = log(max(abs(spectrum[i]), 1e-9));
+  }
+  fft(spectrum, true);
+  for (int i = 0; i < n; ++i) {
+    double scale = i == 0 || i == n / 2 ? 1.0 / n : i < n / 2 ? 2.0 / n : 0;
+    spectrum[i] = spectrum[i].real() * scale;
+  }
+  fft(spectrum, false);
+  for (int i = 0; i < n; ++i) {
+    spectrum[i] = exp(spectrum[i]);
+  }
+  fft(spectrum, true);
+  float sum = 0;
+  float newSum = 0;
+  vector<float> out(length);
+  for (int i = 0; i < length; ++i) {
+    out[i] = spectrum[i].real() / n;
+    sum += coefficients[i];
+    newSum += out[i];
+  }
+  for (int i = 0; newSum != 0 && i < length; ++i) {
+    out[i] *= sum / newSum;
+  }
+  return out;
+}
+
+NCO::NCO(int sampleRate, double freq)
+    : sampleRate_(sampleRate), cosTable_(kChunk + 1), sinTable_(kChunk + 1),
+      cos_(1), sin_(0) {
+  setFrequency(freq);
+}
+
+void NCO::setFrequency(double freq) {
+  for (int i = 0; i <= kChunk; ++i) {
+    cosTable_[i] = cos(k2Pi * freq * i / sampleRate_);
+    sinTable_[i] = sin(k2Pi * freq * i / sampleRate_);
+  }
+}
+
+void NCO::next(int count, float* cosOut, float* sinOut) {
+  for (int i = 0; i < count; ++i) {
+    cosOut[i] = cos_ * cosTable_[i] - sin_ * sinTable_[i];
+    sinOut[i] = cos_ * sinTable_[i] + sin_ * cosTable_[i];
+  }
+  double newCos = cos_ * cosTable_[count] - sin_ * sinTable_[count];
+  sin_ = cos_ * sinTable_[count] + sin_ * cosTable_[count];
+  cos_ = newCos;
+  // Keeps the rounding errors from changing the amplitude over time.
+  double gain = (3 - cos_ * cos_ - sin_ * sin_) / 2;
+  cos_ *= gain;
+  sin_ *= gain;
+}
+
+IQCorrector::IQCorrector()
+    : dcI_(0), dcQ_(0), phase_(0), gain_(1), sumI_(0), sumQ_(0), sumII_(0),
+      sumQQ_(0), sumIQ_(0), count_(0), averaged_(0) {}
+
+void IQCorrector::correct(float* samples, int count) {
+  float sumI = 0;
+  float sumQ = 0;
+  float sumII = 0;
+  float sumQQ = 0;
+  float sumIQ = 0;
+  for (int i = 0; i < count; ++i) {
+    float I = samples[2 * i];
+    float Q = samples[2 * i + 1];
+    sumI += I;
+    sumQ += Q;
+    sumII += I * I;
+    sumQQ += Q * Q;
+    sumIQ += I * Q;
+    float corrI = I - dcI_;
+    samples[2 * i] = corrI;
+    samples[2 * i + 1] = (Q - dcQ_ - phase_ * corrI) * gain_;
+  }
+  sumI_ += sumI;
+  sumQ_ += sumQ;
+  sumII_ += sumII;
+  sumQQ_ += sumQQ;
+  sumIQ_ += sumIQ;
+  count_ += count;
+}
+
+void IQCorrector::update() {
+  if (count_ < kIQUpdateSamples) {
+    return;
+  }
+  double meanI = sumI_ / count_;
+  double meanQ = sumQ_ / count_;
+  double varI = sumII_ / count_ - meanI * meanI;
+  double varQ = sumQQ_ / count_ - meanQ * meanQ;
+  double cov = sumIQ_ / count_ - meanI * meanQ;
+  // A plain average of the updates until there are enough samples.
+  averaged_ = min<double>(averaged_ + count_, kIQAverageSamples);
+  double weight = min(1.0, count_ / averaged_);
+  dcI_ += weight * (meanI - dcI_);
+  dcQ_ += weight * (meanQ - dcQ_);
+  if (varI > 1e-12) {
+    // I leaks into Q by cov / varI; what remains of Q after removing the
+    // I component must be scaled to the power of I.
+    double phase = cov / varI;
+    double remaining = varQ - cov * phase;
+    if (remaining > 1e-12) {
+      phase_ += weight * (phase - phase_);
+      gain_ += weight * (sqrt(varI / remaining) - gain_);
+    }
+  }
+  sumI_ = sumQ_ = sumII_ = sumQQ_ = sumIQ_ = 0;
+  count_ = 0;
+}
+
+/**
+ * Converts interleaved I/Q samples a chunk at a time, and corrects them and
+ * shifts their frequency while the chunk is still in the cache, so that all
+ * the steps take a single pass over the block.
+ */
+template <typename T>
+static Samples convertCorrected(const T* buffer, int length, float scale,
+                                float offset, NCO* nco,
+                                IQCorrector* corrector) {
+  Samples out(length);
+  float cosBuf[NCO::kChunk];
+  float sinBuf[NCO::kChunk];
+  for (int pos = 0; pos < length; pos += 2 * NCO::kChunk) {
+    int len = min(2 * NCO::kChunk, length - pos);
+    int count = len / 2;
+    const T* in = buffer + pos;
+    float* o = out.data() + pos;
+    for (int i = 0; i < len; ++i) {
+      o[i] = in[i] * scale + offset;
+    }
+    if (corrector) {
+      corrector->correct(o, count);
+    }
+    if (nco) {
+      nco->next(count, cosBuf, sinBuf);
+      for (int i = 0; i < count; ++i) {
+        float I = o[2 * i];
+        float Q = o[2 * i + 1];
+        o[2 * i] = I * cosBuf[i] - Q * sinBuf[i];
+        o[2 * i + 1] = I * sinBuf[i] + Q * cosBuf[i];
+      }
+    }
+  }
+  if (corrector) {
+    corrector->update();
+  }
+  return out;
+}
+
+Samples samplesFromUint8(const uint8_t* buffer, int length, NCO* nco,
+                         IQCorrector* corrector) {
+  if (nco || corrector) {
+    return convertCorrected(buffer, length, 1 / 128.0f, -1, nco, corrector);
+  }
   Samples out(length);
   for (int i = 0; i < length; ++i) {
     out[i] = buffer[i] / 128.0 - 1;
@@ -68,7 +654,11 @@ Samples samplesFromUint8(uint8_t* buffer, int length) {
   return out;
 }
 
-Samples samplesFromInt16(int16_t* buffer, int length) {
+Samples samplesFromInt16(const int16_t* buffer, int length, NCO* nco,
+                         IQCorrector* corrector) {
+  if (nco || corrector) {
+    return convertCorrected(buffer, length, 1 / 32768.0f, 0, nco, corrector);
+  }
   Samples out(length);
   for (int i = 0; i < length; ++i) {
     out[i] = buffer[i] / 32768.0;
@@ -76,6 +666,14 @@ Samples samplesFromInt16(int16_t* buffer, int length) {
   return out;
 }
 
+Samples samplesFromFloat32(const float* buffer, int length, NCO* nco,
+                           IQCorrector* corrector) {
+  if (nco || corrector) {
+    return convertCorrected(buffer, length, 1, 0, nco, corrector);
+  }
+  return Samples(buffer, buffer + length);
+}
+
 FIRFilter::FIRFilter(const vector<float>& coefficients, int step)
     : coefficients_(coefficients),
       curSamples_((coefficients.size() - 1) * step, 0),
@@ -84,7 +682,12 @@ FIRFilter::FIRFilter(const vector<float>& coefficients, int step)
 }
 
 void FIRFilter::loadSamples(const Samples& samples) {
-  int fullLen = samples.size() + offset_;
+  float* block = prepare(samples.size());
+  memmove(block, samples.data(), samples.size() * sizeof(float));
+}
+
+float* FIRFilter::prepare(int length) {
+  int fullLen = length + offset_;
   float* curArr = curSamples_.data();
   float* endOfCur = curArr + curSamples_.size() - offset_;
   memmove(curArr, endOfCur, offset_ * sizeof(float));
@@ -92,142 +695,265 @@ void FIRFilter::loadSamples(const Samples& samples) {
     curSamples_.resize(fullLen);
     curArr = curSamples_.data();
   }
-  memmove(curArr + offset_, samples.data(), samples.size() * sizeof(float));
+  return curArr + offset_;
 }
 
-float FIRFilter::get(int index) {
-  float out = 0;
-  for (int ic = 0, is = index, sz = coefficients_.size(); ic < sz;
-       ++ic, is += step_) {
-    out += coefficients_[ic] * curSamples_[is];
+void FIRFilter::reset() {
+  fill(curSamples_.begin(), curSamples_.end(), 0);
+}
+
+void FIRFilter::makeMinimumPhase() {
+  // coefficients_ is reversed, so reverse it around the conversion.
+  vector<float> coefs(coefficients_.rbegin(), coefficients_.rend());
+  coefficients_ = getMinimumPhaseFIRCoeffs(coefs);
+  reverse(coefficients_.begin(), coefficients_.end());
+}
+
+float FIRFilter::delay() const {
+  // coefficients_ is reversed, so the tap for the newest sample is last.
+  float sum = 0;
+  float weighted = 0;
+  for (int i = 0, sz = coefficients_.size(); i < sz; ++i) {
+    sum += coefficients_[i];
+    weighted += coefficients_[i] * (sz - 1 - i);
   }
-  return out;
+  return sum == 0 ? 0 : weighted / sum;
+}
+
+
+ResampleClock::ResampleClock(int inRate, int outRate)
+    : inRate_(inRate), outRate_(outRate), phase_(0) {
+  int64_t a = inRate_;
+  int64_t b = outRate_;
+  while (b != 0) {
+    int64_t r = a % b;
+    a = b;
+    b = r;
+  }
+  if (a > 1) {
+    inRate_ /= a;
+    outRate_ /= a;
+  }
+}
+
+int ResampleClock::outputLength(int length) const {
+  int64_t span = length * outRate_ - phase_;
+  return span > 0 ? (int) ((span + inRate_ - 1) / inRate_) : 0;
+}
+
+void ResampleClock::advance(int length) {
+  phase_ += outputLength(length) * inRate_ - length * outRate_;
 }
 
 
 Downsampler::Downsampler(int inRate, int outRate,
                          const vector<float>& coefs)
-    : filter_(coefs, 1), rateMul_((float) inRate / outRate) {}
+    : filter_(coefs, 1), clock_(inRate, outRate) {}
 
 Samples Downsampler::downsample(const Samples& samples) {
   filter_.loadSamples(samples);
-  int outLen = samples.size() / rateMul_;
+  int outLen = clock_.outputLength(samples.size());
   Samples out(outLen);
-  float readFrom = 0;
-  for (int i = 0; i < outLen; ++i, readFrom += rateMul_) {
-    out[i] = filter_.get((int) readFrom);
+  for (int i = 0; i < outLen; ++i) {
+    out[i] = filter_.get(clock_.position(i));
   }
+  clock_.advance(samples.size());
   return out;
 }
 
+Samples Downsampler::silence(int length) {
+  filter_.reset();
+  int outLen = clock_.outputLength(length);
+  clock_.advance(length);
+  return Samples(outLen, 0);
+}
+
+void Downsampler::makeMinimumPhase() {
+  filter_.makeMinimumPhase();
+}
+
+float Downsampler::delay() const {
+  return filter_.delay();
+}
+
 
 IQDownsampler::IQDownsampler(int inRate, int outRate,
                              const vector<float>& coefs)
-    : filter_(coefs, 2), rateMul_((float) inRate / outRate) {}
+    : filter_(coefs, 2), clock_(inRate, outRate), loaded_(0) {}
 
 SamplesIQ IQDownsampler::downsample(const Samples& samples) {
-  int numSamples = samples.size() / (2 * rateMul_);
+  load(samples);
+  return downsampleLoaded();
+}
+
+void IQDownsampler::load(const Samples& samples) {
   filter_.loadSamples(samples);
+  loaded_ = samples.size();
+}
+
+SamplesIQ IQDownsampler::downsampleLoaded() {
+  int numSamples = outputLength(loaded_);
   SamplesIQ out{Samples(numSamples), Samples(numSamples)};
-  float readFrom = 0;
-  for (int i = 0; i < numSamples; ++i, readFrom += rateMul_) {
-    int idx = 2 * ((int) readFrom);
+  for (int i = 0; i < numSamples; ++i) {
+    int idx = 2 * clock_.position(i);
     out.I[i] = filter_.get(idx);
     out.Q[i] = filter_.get(idx + 1);
   }
+  clock_.advance(loaded_ / 2);
   return out;
 }
 
+float IQDownsampler::power(int stride) {
+  int numSamples = outputLength(loaded_);
+  float sum = 0;
+  int count = 0;
+  for (int i = 0; i < numSamples; i += stride, ++count) {
+    int idx = 2 * clock_.position(i);
+    float I = filter_.get(idx);
+    float Q = filter_.get(idx + 1);
+    sum += I * I + Q * Q;
+  }
+  return count ? sum / count : 0;
+}
 
-AMDemodulator::AMDemodulator(int inRate, int outRate, float filterFreq,
-                             int kernelLen)
-    : downsampler_(inRate, outRate,
-                   getLowPassFIRCoeffs(inRate, filterFreq, kernelLen)) {}
+int IQDownsampler::skipLoaded() {
+  int numSamples = outputLength(loaded_);
+  clock_.advance(loaded_ / 2);
+  return numSamples;
+}
 
-Samples AMDemodulator::demodulateTuned(const Samples& samples) {
-  SamplesIQ iqSamples(downsampler_.downsample(samples));
-  int outLen = iqSamples.I.size();
-  float iAvg = accumulate(iqSamples.I.begin(), iqSamples.I.end(), 0) / outLen;
-  float qAvg = accumulate(iqSamples.Q.begin(), iqSamples.Q.end(), 0) / outLen;
-  Samples out(outLen);
-  float sigSqrSum = 0;
-  float sigSum = 0;
-  for (int i = 0; i < outLen; ++i) {
-    float I = iqSamples.I[i] - iAvg;
-    float Q = iqSamples.Q[i] - qAvg;
-    float power = I * I + Q * Q;
-    float ampl = sqrt(power);
-    out[i] = ampl;
-    sigSum += ampl;
-    sigSqrSum += power;
-  }
-  float halfPoint = sigSum / outLen;
-  for (auto &o : out) {
-    o = (o - halfPoint) / halfPoint;
-  }
-  hasCarrier_ = sigSqrSum > (0.002 * outLen);
-  return out;
+int IQDownsampler::outputLength(int length) const {
+  return clock_.outputLength(length / 2);
+}
+
+void IQDownsampler::makeMinimumPhase() {
+  filter_.makeMinimumPhase();
 }
 
-bool AMDemodulator::hasCarrier() {
-  return hasCarrier_;
+float IQDownsampler::delay() const {
+  return filter_.delay();
 }
 
 
-static float myatan2(float y, float x) {
-  float sgn = 1;
-  if (y < 0) {
-    sgn *= -1;
-    y *= -1;
+Squelch::Squelch()
+    : enabled_(false), open_(true), openPower_(0), closePower_(0) {}
+
+void Squelch::set(float level, float hysteresis) {
+  enabled_ = true;
+  open_ = false;
+  openPower_ = pow(10, level / 10);
+  closePower_ = pow(10, (level - hysteresis) / 10);
+}
+
+bool Squelch::update(float power) {
+  if (!enabled_) {
+    return true;
   }
-  float ang = 0;
-  float div;
-  if (x == y) {
-    div = 1;
-  } else if (x > y) {
-    div = y / x;
-  } else {
-    ang = -kPi2;
-    div = x / y;
-    sgn *= -1;
+  if (open_ && power < closePower_) {
+    open_ = false;
+  } else if (!open_ && power > openPower_) {
+    open_ = true;
+  }
+  return open_;
+}
+
+/**
+ * Returns the mean power of a block of I/Q samples.
+ */
+static float meanPower(const SamplesIQ& samples) {
+  int len = samples.I.size();
+  float sum = 0;
+  for (int i = 0; i < len; ++i) {
+    sum += samples.I[i] * samples.I[i] + samples.Q[i] * samples.Q[i];
   }
-  ang +=
-    div /
-    (0.98419158358617365
-     + div * (0.093485702629671305
-	      + div * 0.19556307900617517));
-  return sgn * ang;
+  return len ? sum / len : 0;
 }
 
 
+FrontEnd::FrontEnd(int inRate, int outRate, float filterFreq, int kernelLen)
+    : downsampler_(inRate, outRate,
+                   getLowPassFIRCoeffs(inRate, filterFreq, kernelLen)),
+      outRate_(outRate) {}
+
+FrontEnd::FrontEnd(int inRate, int outRate,
+                   const vector<float>& coefficients)
+    : downsampler_(inRate, outRate, coefficients), outRate_(outRate) {}
+
+SamplesIQ FrontEnd::process(const Samples& samples) {
+  StageTimer timer(STAGE_FRONTEND, samples.size() / 2);
+  downsampler_.load(samples);
+  // While closed, only a sparse estimate of the channel is computed;
+  // while open, the full channel decides whether to close.
+  if (!squelch_.isOpen()
+      && !squelch_.update(downsampler_.power(kSquelchStride))) {
+    int len = downsampler_.skipLoaded();
+    return SamplesIQ{Samples(len, 0), Samples(len, 0)};
+  }
+  SamplesIQ iqSamples(downsampler_.downsampleLoaded());
+  if (squelch_.enabled() && !squelch_.update(meanPower(iqSamples))) {
+    int len = iqSamples.I.size();
+    return SamplesIQ{Samples(len, 0), Samples(len, 0)};
+  }
+  return iqSamples;
+}
+
+void FrontEnd::setSquelch(float level, float hysteresis) {
+  squelch_.set(level, hysteresis);
+}
+
+void FrontEnd::makeMinimumPhase() {
+  downsampler_.makeMinimumPhase();
+}
+
+float FrontEnd::delay() const {
+  return downsampler_.delay();
+}
+
+
+FMDiscriminator::FMDiscriminator(int sampleRate, int maxF)
+    : amplConv_(sampleRate / (k2Pi * maxF)), lI_(0), lQ_(0), sigSqrSum_(0),
+      hasCarrier_(false) {}
+
+
 FMDemodulator::FMDemodulator(int inRate, int outRate, int maxF,
-                             float filterFreq, int kernelLen)
-  : amplConv_(outRate / (k2Pi * maxF)),
-    downsampler_(inRate, outRate,
-                 getLowPassFIRCoeffs(inRate, filterFreq, kernelLen)),
-    lI_(0), lQ_(0) {}
+                             const vector<float>& coefficients)
+  : frontEnd_(inRate, outRate, coefficients),
+    discriminator_(outRate, maxF), squelched_(false) {}
 
 Samples FMDemodulator::demodulateTuned(const Samples& samples) {
-  SamplesIQ iqSamples(downsampler_.downsample(samples));
+  SamplesIQ iqSamples(frontEnd_.process(samples));
+  return demodulateChannel(iqSamples, frontEnd_.squelched());
+}
+
+Samples FMDemodulator::demodulateChannel(const SamplesIQ& iqSamples,
+                                         bool squelched) {
+  squelched_ = squelched;
+  if (squelched) {
+    // Start from scratch when the squelch opens, as on the first block.
+    discriminator_.reset();
+    return Samples(iqSamples.I.size(), 0);
+  }
   int outLen = iqSamples.I.size();
+  StageTimer timer(STAGE_DISCRIMINATOR, outLen);
   Samples out(outLen);
-  float sigSqrSum = 0;
+  discriminator_.begin();
   for (int i = 0; i < outLen; ++i) {
-    float I = iqSamples.I[i];
-    float Q = iqSamples.Q[i];
-    float real = lI_ * I + lQ_ * Q;
-    float imag = lI_ * Q - I * lQ_;
-    out[i] = myatan2(imag, real) * amplConv_;
-    lI_ = I;
-    lQ_ = Q;
-    sigSqrSum += lI_ * lI_;
-  }
-  hasCarrier_ = sigSqrSum > (0.002 * outLen);
+    out[i] = discriminator_.demodulate(iqSamples.I[i], iqSamples.Q[i]);
+  }
+  discriminator_.end(out.data(), outLen);
   return out;
 }
 
 bool FMDemodulator::hasCarrier() {
-  return hasCarrier_;
+  return discriminator_.hasCarrier();
+}
+
+void FMDemodulator::setSquelch(float level, float hysteresis) {
+  frontEnd_.setSquelch(level, hysteresis);
+}
+
+float FMDemodulator::delay() const {
+  return frontEnd_.delay();
 }
 
 
@@ -290,9 +1016,12 @@ Deemphasizer::Deemphasizer(int sampleRate, int timeConstant_uS)
 
 void Deemphasizer::inPlace(Samples& samples) {
   for (int i = 0, sz = samples.size(); i < sz; ++i) {
-    val_ = (1 - mult_) * samples[i] + mult_ * val_;
-    samples[i] = val_;
+    samples[i] = filter(samples[i]);
   }
 }
 
+float Deemphasizer::delay() const {
+  return mult_ / (1 - mult_);
+}
+
 }  // namespace radioreceiver
@@ -19,6 +19,7 @@
 #ifndef DSP_H_
 #define DSP_H_
 
+#include <cmath>
 #include <memory>
 #include <stdint.h>
 #include <utility>
@@ -51,23 +52,123 @@ struct StereoAudio {
   bool carrier;
 };
 
+/**
+ * A numerically controlled oscillator to shift the frequency of an I/Q
+ * stream, with a phase that is continuous from one block to the next.
+ * It produces its output a chunk at a time, as a precomputed table of
+ * phasors rotated by the phase at the start of the chunk, so that the
+ * mixing loop has no dependency from one sample to the next.
+ */
+class NCO {
+  int sampleRate_;
+  vector<double> cosTable_;
+  vector<double> sinTable_;
+  double cos_;
+  double sin_;
+
+ public:
+  /** The largest number of samples returned at once by next(). */
+  static const int kChunk = 64;
+
+  /**
+   * Constructor for the oscillator.
+   * @param sampleRate The sample rate of the I/Q stream.
+   * @param freq The frequency to shift the stream by, in Hz.
+   */
+  NCO(int sampleRate, double freq);
+
+  /**
+   * Changes the frequency of the oscillator, keeping its phase continuous.
+   * @param freq The frequency to shift the stream by, in Hz.
+   */
+  void setFrequency(double freq);
+
+  /**
+   * Returns the oscillator's next samples.
+   * @param count The number of samples, at most kChunk.
+   * @param cosOut The array to write the real parts to.
+   * @param sinOut The array to write the imaginary parts to.
+   */
+  void next(int count, float* cosOut, float* sinOut);
+};
+
+/**
+ * Removes the DC offset that a tuner adds to its I/Q samples, and the
+ * gain and phase imbalance between its I and Q branches. They are
+ * estimated from the signal itself, assuming that over time the I and Q
+ * components average zero, have the same power and are uncorrelated, and
+ * the estimates follow them slowly as they drift.
+ */
+class IQCorrector {
+  float dcI_;
+  float dcQ_;
+  float phase_;
+  float gain_;
+  double sumI_;
+  double sumQ_;
+  double sumII_;
+  double sumQQ_;
+  double sumIQ_;
+  int64_t count_;
+  double averaged_;
+
+ public:
+  IQCorrector();
+
+  /**
+   * Corrects interleaved I/Q samples in place with the current estimates,
+   * and adds the uncorrected samples to the statistics for the next ones.
+   * @param samples The samples to correct.
+   * @param count The number of I/Q pairs.
+   */
+  void correct(float* samples, int count);
+
+  /**
+   * Updates the estimates with the samples seen since the last update,
+   * once there are enough of them.
+   */
+  void update();
+};
+
 /**
  * Converts the given buffer of unsigned 8-bit samples into a samples object.
  * @param buffer A buffer containing the unsigned 8-bit samples.
  * @param length The buffer's length.
- * @param rate The buffer's sample rate.
+ * @param nco An oscillator to shift the I/Q samples' frequency with while
+ *     converting them, or 0 to leave them as they are.
+ * @param corrector A corrector to remove the tuner's DC offset and I/Q
+ *     imbalance with before shifting the samples, or 0.
  * @return The converted samples.
  */
-Samples samplesFromUint8(uint8_t* buffer, int length);
+Samples samplesFromUint8(const uint8_t* buffer, int length, NCO* nco = 0,
+                         IQCorrector* corrector = 0);
 
 /**
  * Converts the given buffer of signed 16-bit samples into a samples object.
  * @param buffer A buffer containing the signed 16-bit samples.
  * @param length The buffer's length.
- * @param rate The buffer's sample rate.
+ * @param nco An oscillator to shift the I/Q samples' frequency with while
+ *     converting them, or 0 to leave them as they are.
+ * @param corrector A corrector to remove the tuner's DC offset and I/Q
+ *     imbalance with before shifting the samples, or 0.
  * @return The converted samples.
  */
-Samples samplesFromInt16(int16_t* buffer, int length);
+Samples samplesFromInt16(const int16_t* buffer, int length, NCO* nco = 0,
+                         IQCorrector* corrector = 0);
+
+/**
+ * Converts the given buffer of 32-bit floating-point samples into a samples
+ * object.
+ * @param buffer A buffer containing the floating-point samples.
+ * @param length The buffer's length.
+ * @param nco An oscillator to shift the I/Q samples' frequency with while
+ *     converting them, or 0 to leave them as they are.
+ * @param corrector A corrector to remove the tuner's DC offset and I/Q
+ *     imbalance with before shifting the samples, or 0.
+ * @return The converted samples.
+ */
+Samples samplesFromFloat32(const float* buffer, int length, NCO* nco = 0,
+                           IQCorrector* corrector = 0);
 
 /**
  * Generates coefficients for a FIR low-pass filter with the given
@@ -80,6 +181,81 @@ Samples samplesFromInt16(int16_t* buffer, int length);
 vector<float> getLowPassFIRCoeffs(int sampleRate, float halfAmplFreq,
                                   int length);
 
+/**
+ * Generates the coefficients of the shortest Kaiser-windowed FIR low-pass
+ * filter that meets a specification, with the same deviation in both
+ * bands. Kaiser's formulas give the window's shape and a first length,
+ * which is then adjusted against the actual response.
+ * @param sampleRate The signal's sample rate.
+ * @param passFreq The passband edge in Hz.
+ * @param stopFreq The stopband edge in Hz.
+ * @param attenuation The minimum stopband attenuation in dB.
+ * @return The filter coefficients, an odd number of them, or a single one
+ *     if the stopband starts above the Nyquist frequency.
+ */
+vector<float> getKaiserFIRCoeffs(int sampleRate, float passFreq,
+                                 float stopFreq, float attenuation);
+
+/**
+ * Generates the coefficients of the shortest equiripple FIR low-pass
+ * filter that meets a specification, designed with the Parks-McClellan
+ * algorithm. Unlike a window design, it can trade a looser passband ripple
+ * for fewer taps, and it spreads the error evenly over each band, so it
+ * needs the fewest taps of any linear-phase filter for the specification.
+ * @param sampleRate The signal's sample rate.
+ * @param passFreq The passband edge in Hz.
+ * @param stopFreq The stopband edge in Hz.
+ * @param attenuation The minimum stopband attenuation in dB.
+ * @param ripple The maximum passband ripple in dB, peak to peak.
+ * @return The filter coefficients, an odd number of them, or a single one
+ *     if the stopband starts above the Nyquist frequency.
+ */
+vector<float> getEquirippleFIRCoeffs(int sampleRate, float passFreq,
+                                     float stopFreq, float attenuation,
+                                     float ripple);
+
+/**
+ * Converts the coefficients of a linear-phase FIR filter into those of a
+ * minimum-phase filter with the same magnitude response and length. Most
+ * of the energy of the new kernel comes first, so its group delay at low
+ * frequencies is a fraction of the original's half kernel length, at the
+ * cost of a delay that varies across the passband.
+ * @param coefficients The linear-phase coefficients.
+ * @return The minimum-phase coefficients.
+ */
+vector<float> getMinimumPhaseFIRCoeffs(const vector<float>& coefficients);
+
+/**
+ * A fast approximation of atan2, used by the FM discriminator.
+ * @param y The imaginary component.
+ * @param x The real component.
+ * @return The approximate angle in radians.
+ */
+inline float myatan2(float y, float x) {
+  float sgn = 1;
+  if (y < 0) {
+    sgn *= -1;
+    y *= -1;
+  }
+  float ang = 0;
+  float div;
+  if (x == y) {
+    div = 1;
+  } else if (x > y) {
+    div = y / x;
+  } else {
+    ang = -1.57079632679489661923f;
+    div = x / y;
+    sgn *= -1;
+  }
+  ang +=
+    div /
+    (0.98419158358617365
+     + div * (0.093485702629671305
+              + div * 0.19556307900617517));
+  return sgn * ang;
+}
+
 /**
  * A Finite Impulse Response filter.
  */
@@ -103,12 +279,91 @@ class FIRFilter {
    */
   void loadSamples(const Samples& samples);
 
+  /**
+   * Makes room for a new block of samples to filter, to be written in
+   * place instead of loaded with loadSamples().
+   * @param length The length of the new block.
+   * @return Where to write the new block.
+   */
+  float* prepare(int length);
+
   /**
    * Returns a filtered sample.
    * @param index The index of the sample to return, corresponding
    *     to the same index in the latest sample block loaded via loadSamples().
    */
-  float get(int index);
+  float get(int index) {
+    float out = 0;
+    const float* samples = curSamples_.data() + index;
+    for (int ic = 0, sz = coefficients_.size(); ic < sz; ++ic) {
+      out += coefficients_[ic] * samples[ic * step_];
+    }
+    return out;
+  }
+
+  /**
+   * Forgets the samples loaded so far, as if the filter had only been fed
+   * zeros.
+   */
+  void reset();
+
+  /**
+   * Replaces the filter's kernel with its minimum-phase equivalent.
+   */
+  void makeMinimumPhase();
+
+  /**
+   * Returns the filter's group delay at low frequencies.
+   * @return The delay in samples of the filtered stream.
+   */
+  float delay() const;
+};
+
+/**
+ * Keeps track of where the output samples of a resampler fall in its input
+ * stream. The position is kept as an exact fraction, so that blocks of any
+ * length can be resampled one after another without the output drifting
+ * or jumping at the block boundaries.
+ */
+class ResampleClock {
+  int64_t inRate_;
+  int64_t outRate_;
+  int64_t phase_;
+
+ public:
+  /**
+   * Constructor with the given input and output rate. Only their ratio
+   * matters, so it is kept reduced.
+   * @param inRate The input signal's sample rate.
+   * @param outRate The output signal's sample rate.
+   */
+  ResampleClock(int inRate, int outRate);
+
+  /**
+   * Returns the number of output samples that fall in the next input block.
+   * @param length The length of the next input block.
+   * @return The number of output samples.
+   */
+  int outputLength(int length) const;
+
+  /**
+   * Returns the index in the next input block of an output sample.
+   * @param index The index of the output sample within the block.
+   * @return The index of the input sample it is read from.
+   */
+  int position(int index) const {
+    // Integer ratios, including unity, don't need the division.
+    if (outRate_ == 1) {
+      return (int) (phase_ + index * inRate_);
+    }
+    return (int) ((phase_ + index * inRate_) / outRate_);
+  }
+
+  /**
+   * Moves past an input block.
+   * @param length The length of the input block.
+   */
+  void advance(int length);
 };
 
 /**
@@ -116,7 +371,7 @@ class FIRFilter {
  */
 class Downsampler {
   FIRFilter filter_;
-  float rateMul_;
+  ResampleClock clock_;
 
  public:
   /**
@@ -134,6 +389,59 @@ class Downsampler {
    * @return The downsampled block.
    */
   Samples downsample(const Samples& samples);
+
+  /**
+   * Makes room for a new block of samples, to be written in place and
+   * downsampled one output at a time with get() until finish() is called.
+   * @param length The length of the new block.
+   * @return Where to write the new block.
+   */
+  float* prepare(int length) { return filter_.prepare(length); }
+
+  /**
+   * Returns the length of the downsampled version of the next block.
+   * @param length The length of the block.
+   */
+  int outputLength(int length) const { return clock_.outputLength(length); }
+
+  /**
+   * Returns the index in the block where an output sample is taken.
+   * @param index The index of the output sample.
+   */
+  int position(int index) const { return clock_.position(index); }
+
+  /**
+   * Returns an output sample of the prepared block. The block must have
+   * been written up to the given position.
+   * @param position The position of the output sample, from position().
+   */
+  float get(int position) { return filter_.get(position); }
+
+  /**
+   * Moves on from the prepared block.
+   * @param length The length of the block.
+   */
+  void finish(int length) { clock_.advance(length); }
+
+  /**
+   * Returns a block of silence as long as the downsampled version of a
+   * block of the given length, and clears the filter so that the signal
+   * that follows doesn't pick up stale samples.
+   * @param length The length of the skipped input block.
+   * @return The silent block.
+   */
+  Samples silence(int length);
+
+  /**
+   * Replaces the filter's kernel with its minimum-phase equivalent.
+   */
+  void makeMinimumPhase();
+
+  /**
+   * Returns the group delay of the filter applied before downsampling.
+   * @return The delay in input samples.
+   */
+  float delay() const;
 };
 
 /**
@@ -141,7 +449,8 @@ class Downsampler {
  */
 class IQDownsampler {
   FIRFilter filter_;
-  float rateMul_;
+  ResampleClock clock_;
+  int loaded_;
 
  public:
   /**
@@ -159,61 +468,304 @@ class IQDownsampler {
    * @return The deinterlaced and downsampled block.
    */
   SamplesIQ downsample(const Samples& samples);
+
+  /**
+   * Loads a block of samples without downsampling it, so that its power
+   * can be estimated before deciding whether to downsample it.
+   * @param samples The sample block to load.
+   */
+  void load(const Samples& samples);
+
+  /**
+   * Returns the downsampled version of the block loaded with load().
+   * @return The deinterlaced and downsampled block.
+   */
+  SamplesIQ downsampleLoaded();
+
+  /**
+   * Estimates the mean power of the downsampled version of the block loaded
+   * with load() by computing only some of its samples.
+   * @param stride The number of output samples to skip between the samples
+   *     computed.
+   * @return The mean of I^2 + Q^2.
+   */
+  float power(int stride);
+
+  /**
+   * Skips the block loaded with load() without downsampling it.
+   * @return The number of I/Q samples its downsampled version would have.
+   */
+  int skipLoaded();
+
+  /**
+   * Returns the length of the downsampled version of a block.
+   * @param length The length of the interleaved input block.
+   * @return The number of I/Q samples in the output.
+   */
+  int outputLength(int length) const;
+
+  /**
+   * Replaces the filter's kernel with its minimum-phase equivalent.
+   */
+  void makeMinimumPhase();
+
+  /**
+   * Returns the group delay of the filter applied before downsampling.
+   * @return The delay in input I/Q samples.
+   */
+  float delay() const;
 };
 
 /**
- * A class to demodulate IQ-interleaved samples representing an amplitude
- * modulated signal into a raw audio signal.
+ * A power squelch with hysteresis. It opens when the power of the channel
+ * goes over the threshold and closes when it falls the hysteresis below it.
  */
-class AMDemodulator {
+class Squelch {
+  bool enabled_;
+  bool open_;
+  float openPower_;
+  float closePower_;
+
+ public:
+  Squelch();
+
+  /**
+   * Enables the squelch.
+   * @param level The threshold in dB relative to a full-scale carrier.
+   * @param hysteresis How far below the threshold the power must fall for
+   *     the squelch to close, in dB.
+   */
+  void set(float level, float hysteresis);
+
+  /**
+   * Tells whether the squelch has been enabled.
+   */
+  bool enabled() const { return enabled_; }
+
+  /**
+   * Tells whether the squelch is letting the signal through.
+   */
+  bool isOpen() const { return open_; }
+
+  /**
+   * Opens or closes the squelch according to the channel's power.
+   * @param power The mean power of the channel's I/Q samples.
+   * @return Whether the squelch is open.
+   */
+  bool update(float power);
+};
+
+/**
+ * The front end of a receiver: filters the channel out of the interleaved
+ * I/Q stream coming from the tuner and downsamples it, with an optional
+ * power squelch. Its output can be shared by several demodulators.
+ */
+class FrontEnd {
   IQDownsampler downsampler_;
-  bool hasCarrier_;
+  Squelch squelch_;
+  int outRate_;
  public:
   /**
-   * Constructor for the given rates and maximum frequency deviation.
+   * Constructor for the given rates and filter.
    * @param inRate The sample rate for the input signal.
-   * @param outRate The sample rate for the output audio.
-   * @param filterFreq The frequeny of the low-pass filter.
+   * @param outRate The sample rate for the channel.
+   * @param filterFreq The frequency of the low-pass filter.
    * @param kernelLen The length of the filter kernel.
    */
-  AMDemodulator(int inRate, int outRate, float filterFreq, int kernelLen);
+  FrontEnd(int inRate, int outRate, float filterFreq, int kernelLen);
 
   /**
-   * Demodulates the given I/Q samples.
-   * @param samples The samples to demodulate.
-   * @return The demodulated sound.
+   * Constructor for the given rates and filter coefficients.
+   * @param inRate The sample rate for the input signal.
+   * @param outRate The sample rate for the channel.
+   * @param coefficients The coefficients of the low-pass filter.
    */
-  Samples demodulateTuned(const Samples& samples);
+  FrontEnd(int inRate, int outRate, const vector<float>& coefficients);
 
   /**
-   * Tells whether a carrier was detected in the last demodulated block.
-   * @return Whether a carrier was detected.
+   * Filters and downsamples a block of I/Q samples. While the squelch is
+   * closed, only a sparse estimate of the channel's power is computed and
+   * the block returned is all zeros.
+   * @param samples The interleaved samples.
+   * @return The deinterlaced channel.
    */
-  bool hasCarrier();
+  SamplesIQ process(const Samples& samples);
+
+  /**
+   * Enables a squelch that estimates the channel's power before filtering
+   * each block, and skips the filter while the power is below the
+   * threshold.
+   * @param level The threshold in dB relative to a full-scale carrier.
+   * @param hysteresis How far below the threshold the power must fall for
+   *     the squelch to close, in dB.
+   */
+  void setSquelch(float level, float hysteresis);
+
+  /**
+   * Tells whether the squelch silenced the last block.
+   */
+  bool squelched() const { return !squelch_.isOpen(); }
+
+  /**
+   * Replaces the channel filter with its minimum-phase equivalent.
+   */
+  void makeMinimumPhase();
+
+  /**
+   * Returns the sample rate of the channel.
+   */
+  int outRate() const { return outRate_; }
+
+  /**
+   * Returns the group delay of the channel filter.
+   * @return The delay in input I/Q samples.
+   */
+  float delay() const;
+};
+
+/**
+ * An AM envelope detector that works one sample at a time, so that it can
+ * be fused with the stages that follow it in a Pipeline. The audio is
+ * normalized to the block's mean carrier level at the end of each block.
+ */
+class AMDetector {
+  float sigSum_;
+  float sigSqrSum_;
+  bool hasCarrier_;
+
+ public:
+  AMDetector() : sigSum_(0), sigSqrSum_(0), hasCarrier_(false) {}
+
+  /**
+   * Starts a block.
+   */
+  void begin() {
+    sigSum_ = 0;
+    sigSqrSum_ = 0;
+  }
+
+  /**
+   * Demodulates a channel sample.
+   * @param I The sample's I component.
+   * @param Q The sample's Q component.
+   * @return The demodulated sample.
+   */
+  float demodulate(float I, float Q) {
+    float power = I * I + Q * Q;
+    float ampl = sqrt(power);
+    sigSum_ += ampl;
+    sigSqrSum_ += power;
+    return ampl;
+  }
+
+  /**
+   * Finishes a block.
+   * @param samples The demodulated block, which is normalized in place.
+   * @param length The length of the block.
+   */
+  void end(float* samples, int length) {
+    float halfPoint = sigSum_ / length;
+    for (int i = 0; i < length; ++i) {
+      samples[i] = (samples[i] - halfPoint) / halfPoint;
+    }
+    hasCarrier_ = sigSqrSum_ > (0.002 * length);
+  }
+
+  /**
+   * Forgets the signal, for a block silenced by the squelch.
+   */
+  void reset() { hasCarrier_ = false; }
+
+  /**
+   * Tells whether a carrier was detected in the last block.
+   */
+  bool hasCarrier() const { return hasCarrier_; }
 };
 
 
 /**
- * A class to demodulate IQ-interleaved samples representing a frequency
- * modulated signal into a raw audio signal.
+ * An FM discriminator that works one sample at a time, so that it can be
+ * fused with the stages that follow it in a Pipeline.
  */
-class FMDemodulator {
+class FMDiscriminator {
   float amplConv_;
-  IQDownsampler downsampler_;
   float lI_;
   float lQ_;
+  float sigSqrSum_;
   bool hasCarrier_;
+
  public:
   /**
-   * Constructor for the given rates and maximum frequency deviation.
+   * Constructor for the given rate and maximum frequency deviation.
+   * @param sampleRate The channel's sample rate.
+   * @param maxF The maximum frequency deviation.
+   */
+  FMDiscriminator(int sampleRate, int maxF);
+
+  /**
+   * Starts a block.
+   */
+  void begin() { sigSqrSum_ = 0; }
+
+  /**
+   * Demodulates a channel sample.
+   * @param I The sample's I component.
+   * @param Q The sample's Q component.
+   * @return The demodulated sample.
+   */
+  float demodulate(float I, float Q) {
+    float real = lI_ * I + lQ_ * Q;
+    float imag = lI_ * Q - I * lQ_;
+    lI_ = I;
+    lQ_ = Q;
+    sigSqrSum_ += I * I;
+    return myatan2(imag, real) * amplConv_;
+  }
+
+  /**
+   * Finishes a block. Unlike AMDetector, it leaves the demodulated block as
+   * it is, so only the length is named.
+   * @param length The length of the block.
+   */
+  void end(float*, int length) {
+    hasCarrier_ = sigSqrSum_ > (0.002 * length);
+  }
+
+  /**
+   * Starts from scratch, for a block silenced by the squelch.
+   */
+  void reset() {
+    lI_ = 0;
+    lQ_ = 0;
+    hasCarrier_ = false;
+  }
+
+  /**
+   * Tells whether a carrier was detected in the last block.
+   */
+  bool hasCarrier() const { return hasCarrier_; }
+};
+
+
+/**
+ * A class to demodulate IQ-interleaved samples representing a frequency
+ * modulated signal into a raw audio signal.
+ */
+class FMDemodulator {
+  FrontEnd frontEnd_;
+  FMDiscriminator discriminator_;
+  bool squelched_;
+ public:
+  /**
+   * Constructor for the given rates, maximum frequency deviation and
+   * channel filter.
    * @param inRate The sample rate for the input signal.
    * @param outRate The sample rate for the output audio.
    * @param maxF The maximum frequency deviation.
-   * @param filterFreq The frequeny of the low-pass filter.
-   * @param kernelLen The length of the filter kernel.
+   * @param coefficients The coefficients of the channel filter.
    */
-  FMDemodulator(int inRate, int outRate, int maxF, float filterFreq,
-                int kernelLen);
+  FMDemodulator(int inRate, int outRate, int maxF,
+                const vector<float>& coefficients);
 
   /**
    * Demodulates the given I/Q samples.
@@ -222,11 +774,46 @@ class FMDemodulator {
    */
   Samples demodulateTuned(const Samples& samples);
 
+  /**
+   * Demodulates a channel that has already gone through a front end, such
+   * as one shared with other demodulators.
+   * @param iqSamples The channel's samples, at the output rate.
+   * @param squelched Whether the front end's squelch silenced the block.
+   * @return The demodulated sound.
+   */
+  Samples demodulateChannel(const SamplesIQ& iqSamples, bool squelched);
+
   /**
    * Tells whether a carrier was detected in the last demodulated block.
    * @return Whether a carrier was detected.
    */
   bool hasCarrier();
+
+  /**
+   * Enables a squelch that estimates the channel's power before
+   * demodulating each block, and returns silence without demodulating it
+   * while the power is below the threshold.
+   * @param level The threshold in dB relative to a full-scale carrier.
+   * @param hysteresis How far below the threshold the power must fall for
+   *     the squelch to close, in dB.
+   */
+  void setSquelch(float level, float hysteresis);
+
+  /**
+   * Tells whether the squelch silenced the last block.
+   */
+  bool squelched() const { return squelched_; }
+
+  /**
+   * Returns the demodulator's own front end.
+   */
+  FrontEnd& frontEnd() { return frontEnd_; }
+
+  /**
+   * Returns the group delay of the demodulator's channel filter.
+   * @return The delay in input I/Q samples.
+   */
+  float delay() const;
 };
 
 
@@ -292,6 +879,22 @@ class Deemphasizer {
    * @param samples The samples to deemphasize.
    */
   void inPlace(Samples& samples);
+
+  /**
+   * Deemphasizes a sample.
+   * @param sample The sample to deemphasize.
+   * @return The deemphasized sample.
+   */
+  float filter(float sample) {
+    val_ = (1 - mult_) * sample + mult_ * val_;
+    return val_;
+  }
+
+  /**
+   * Returns the filter's group delay at low frequencies.
+   * @return The delay in samples.
+   */
+  float delay() const;
 };
 
 
@@ -0,0 +1,954 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * A decoder assembled at runtime from a description of its stages.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "dsp.h"
+#include "flowgraph.h"
+#include "stats.h"
+
+using namespace std;
+
+namespace radioreceiver {
+
+/**
+ * A node of the graph. The executor points in and out to the buffers of
+ * the stage's input and output ports before the first block.
+ */
+class Flowgraph::Stage {
+ public:
+  vector<int> inputs;
+  vector<int> outputs;
+  vector<Buffer*> in;
+  vector<Buffer*> out;
+
+  virtual ~Stage() {}
+
+  /**
+   * Processes a block from the input buffers into the output buffers.
+   * @param inStereo Whether to try decoding a stereo signal.
+   */
+  virtual void process(bool inStereo) = 0;
+
+  /**
+   * Produces the output for a block silenced by the squelch.
+   */
+  virtual void silence() { process(false); }
+
+  /**
+   * Tells whether the stage can write each output over the input with the
+   * same index.
+   */
+  virtual bool inPlace() const { return false; }
+
+  /**
+   * Returns the stage's group delay in seconds.
+   */
+  virtual double delay() const { return 0; }
+
+  /**
+   * Replaces the stage's filters with minimum-phase ones.
+   */
+  virtual void makeMinimumPhase() {}
+
+  /**
+   * Returns the stage's front end, if it is one.
+   */
+  virtual FrontEnd* frontEnd() { return 0; }
+
+  /**
+   * Tells whether the stage detected a carrier in the last block.
+   */
+  virtual bool hasCarrier() const { return false; }
+
+  /**
+   * Tells whether the stage found a stereo pilot in the last block.
+   */
+  virtual bool hasPilot() const { return false; }
+
+ protected:
+  /**
+   * Returns the first output's samples, holding a copy of the first
+   * input's unless the stage works in place.
+   */
+  Samples& inPlaceOutput() {
+    if (out[0] != in[0]) {
+      out[0]->real = in[0]->real;
+    }
+    return out[0]->real;
+  }
+};
+
+namespace {
+
+// Marks the parameters a stage can't do without.
+const double kRequired = NAN;
+
+// The defaults of the stages.
+const int kFrontEndTaps = 351;
+const int kMaxF = 10000;
+const int kAudioCutoff = 10000;
+const int kAudioTaps = 41;
+const float kAttenuation = 70;
+const float kRipple = 0.1;
+const int kDeemphTc = 50;
+const int kPilotFreq = 19000;
+
+// The longest filter a statement can ask for, the same limit the
+// spec-driven designers have.
+const int kMaxTaps = 4095;
+
+typedef Flowgraph::Stage Stage;
+
+class FrontEndStage : public Stage {
+  FrontEnd frontEnd_;
+  int inRate_;
+
+ public:
+  FrontEndStage(int inRate, int outRate, const vector<float>& coefficients)
+      : frontEnd_(inRate, outRate, coefficients), inRate_(inRate) {}
+
+  void process(bool inStereo) {
+    out[0]->iq = frontEnd_.process(*in[0]->raw);
+    out[0]->silent = frontEnd_.squelched();
+  }
+
+  double delay() const { return frontEnd_.delay() / inRate_; }
+  void makeMinimumPhase() { frontEnd_.makeMinimumPhase(); }
+  FrontEnd* frontEnd() { return &frontEnd_; }
+};
+
+/**
+ * A demodulator built on an AMDetector or FMDiscriminator.
+ */
+template <typename Detector>
+class DetectorStage : public Stage {
+  Detector detector_;
+
+ public:
+  explicit DetectorStage(const Detector& detector) : detector_(detector) {}
+
+  void process(bool inStereo) {
+    const SamplesIQ& channel = in[0]->iq;
+    int length = channel.I.size();
+    StageTimer timer(STAGE_DISCRIMINATOR, length);
+    Samples& demodulated = out[0]->real;
+    demodulated.resize(length);
+    Detector detector(detector_);
+    detector.begin();
+    for (int i = 0; i < length; ++i) {
+      demodulated[i] = detector.demodulate(channel.I[i], channel.Q[i]);
+    }
+    detector.end(demodulated.data(), length);
+    detector_ = detector;
+  }
+
+  void silence() {
+    detector_.reset();
+    out[0]->real.assign(in[0]->iq.I.size(), 0);
+  }
+
+  bool hasCarrier() const { return detector_.hasCarrier(); }
+};
+
+class ResampleStage : public Stage {
+  vector<float> coefs_;
+  Downsampler resampler_;
+  int inRate_;
+  int outRate_;
+
+ public:
+  ResampleStage(int inRate, int outRate, const vector<float>& coefs)
+      : coefs_(coefs), resampler_(inRate, outRate, coefs), inRate_(inRate),
+        outRate_(outRate) {}
+
+  int inRate() const { return inRate_; }
+  int outRate() const { return outRate_; }
+  const vector<float>& coefs() const { return coefs_; }
+
+  void process(bool inStereo) {
+    // The input is copied into the filter's history first, so the output
+    // can go over it.
+    const Samples& samples = in[0]->real;
+    int length = samples.size();
+    StageTimer timer(STAGE_RESAMPLER, length);
+    copy(samples.begin(), samples.end(), resampler_.prepare(length));
+    Samples& audio = out[0]->real;
+    audio.resize(resampler_.outputLength(length));
+    for (int j = 0; j < audio.size(); ++j) {
+      audio[j] = resampler_.get(resampler_.position(j));
+    }
+    resampler_.finish(length);
+  }
+
+  void silence() {
+    out[0]->real = resampler_.silence(in[0]->real.size());
+  }
+
+  bool inPlace() const { return true; }
+  double delay() const { return resampler_.delay() / inRate_; }
+  void makeMinimumPhase() { resampler_.makeMinimumPhase(); }
+};
+
+class DeemphStage : public Stage {
+  Deemphasizer deemph_;
+  int rate_;
+
+ public:
+  DeemphStage(int rate, int timeConstant_uS)
+      : deemph_(rate, timeConstant_uS), rate_(rate) {}
+
+  void process(bool inStereo) {
+    Samples& audio = inPlaceOutput();
+    StageTimer timer(STAGE_DEEMPHASIS, audio.size());
+    deemph_.inPlace(audio);
+  }
+
+  // Holds the filter's state until the squelch opens.
+  void silence() { out[0]->real.assign(in[0]->real.size(), 0); }
+
+  bool inPlace() const { return true; }
+  double delay() const { return deemph_.delay() / rate_; }
+};
+
+class GainStage : public Stage {
+  float gain_;
+
+ public:
+  explicit GainStage(float gain) : gain_(gain) {}
+
+  float gain() const { return gain_; }
+
+  void process(bool inStereo) {
+    for (float& sample : inPlaceOutput()) {
+      sample *= gain_;
+    }
+  }
+
+  bool inPlace() const { return true; }
+};
+
+class StereoStage : public Stage {
+  StereoSeparator separator_;
+  bool hasPilot_;
+
+ public:
+  StereoStage(int rate, int pilotFreq)
+      : separator_(rate, pilotFreq), hasPilot_(false) {}
+
+  void process(bool inStereo) {
+    const Samples& demodulated = in[0]->real;
+    if (!inStereo) {
+      silence();
+      return;
+    }
+    StageTimer timer(STAGE_PILOT_PLL, demodulated.size());
+    StereoSignal stereo = separator_.separate(demodulated);
+    hasPilot_ = stereo.hasPilot;
+    if (hasPilot_) {
+      out[0]->real.swap(stereo.diff);
+    } else {
+      out[0]->real.assign(demodulated.size(), 0);
+    }
+  }
+
+  void silence() {
+    hasPilot_ = false;
+    out[0]->real.assign(in[0]->real.size(), 0);
+  }
+
+  bool hasPilot() const { return hasPilot_; }
+};
+
+/**
+ * Turns the mono sum and the difference signal of broadcast FM into the
+ * left and right channels.
+ */
+class MatrixStage : public Stage {
+ public:
+  void process(bool inStereo) {
+    const Samples& mono = in[0]->real;
+    const Samples& diff = in[1]->real;
+    Samples& left = out[0]->real;
+    Samples& right = out[1]->real;
+    int length = mono.size();
+    left.resize(length);
+    right.resize(length);
+    for (int i = 0; i < length; ++i) {
+      float m = mono[i];
+      float d = 2 * diff[i];
+      left[i] = m + d;
+      right[i] = m - d;
+    }
+  }
+
+  bool inPlace() const { return true; }
+};
+
+/**
+ * Returns the coefficients of a filter multiplied by a gain.
+ */
+vector<float> scaled(const vector<float>& coefs, float gain) {
+  vector<float> out(coefs);
+  for (float& coef : out) {
+    coef *= gain;
+  }
+  return out;
+}
+
+/**
+ * Merges two resamplers in a row into one, if the merged filter costs less
+ * and its output falls on the same input samples: the first resampler
+ * must keep the rate, or both ratios must be integers. The second filter
+ * is spread out to the first one's input rate and convolved with the first
+ * filter.
+ * @param first The first resampler.
+ * @param second The resampler reading the first one's output.
+ * @return The merged resampler, or 0.
+ */
+Stage* mergeResamplers(const ResampleStage& first,
+                       const ResampleStage& second) {
+  if (first.inRate() % first.outRate() != 0
+      || (first.inRate() != first.outRate()
+          && second.inRate() % second.outRate() != 0)) {
+    return 0;
+  }
+  int factor = first.inRate() / first.outRate();
+  const vector<float>& a = first.coefs();
+  const vector<float>& b = second.coefs();
+  int length = a.size() + factor * (b.size() - 1);
+  // The cost of each is the number of taps computed per second.
+  double separate = (double) a.size() * first.outRate()
+      + (double) b.size() * second.outRate();
+  if ((double) length * second.outRate() > separate) {
+    return 0;
+  }
+  vector<float> merged(length, 0);
+  for (int i = 0; i < a.size(); ++i) {
+    for (int j = 0; j < b.size(); ++j) {
+      merged[i + factor * j] += a[i] * b[j];
+    }
+  }
+  return new ResampleStage(first.inRate(), second.outRate(), merged);
+}
+
+/**
+ * Merges two linear stages in a row into one.
+ * @param first The first stage.
+ * @param second The stage reading the first one's only output.
+ * @return The merged stage, or 0 if the stages can't be merged.
+ */
+Stage* mergeStages(Stage* first, Stage* second) {
+  GainStage* firstGain = dynamic_cast<GainStage*>(first);
+  GainStage* secondGain = dynamic_cast<GainStage*>(second);
+  ResampleStage* firstResample = dynamic_cast<ResampleStage*>(first);
+  ResampleStage* secondResample = dynamic_cast<ResampleStage*>(second);
+  if (firstGain && secondGain) {
+    return new GainStage(firstGain->gain() * secondGain->gain());
+  }
+  if (firstGain && secondResample) {
+    return new ResampleStage(secondResample->inRate(),
+                             secondResample->outRate(),
+                             scaled(secondResample->coefs(),
+                                    firstGain->gain()));
+  }
+  if (firstResample && secondGain) {
+    return new ResampleStage(firstResample->inRate(),
+                             firstResample->outRate(),
+                             scaled(firstResample->coefs(),
+                                    secondGain->gain()));
+  }
+  if (firstResample && secondResample) {
+    return mergeResamplers(*firstResample, *secondResample);
+  }
+  return 0;
+}
+
+/**
+ * Fills in the parameters a stage type takes with their defaults and
+ * rejects the others.
+ * @param given The parameters in the statement.
+ * @param spec The parameters the type takes and their defaults, or
+ *     kRequired.
+ * @param params The map to fill.
+ * @param why Where to say what is wrong.
+ * @return Whether the parameters are valid.
+ */
+bool takeParams(const map<string, double>& given,
+                const vector<pair<string, double> >& spec,
+                map<string, double>* params, string* why) {
+  for (const pair<string, double>& param : spec) {
+    (*params)[param.first] = param.second;
+  }
+  for (const pair<const string, double>& param : given) {
+    if (!params->count(param.first)) {
+      *why = "unknown parameter " + param.first;
+      return false;
+    }
+    (*params)[param.first] = param.second;
+  }
+  for (const pair<string, double>& param : spec) {
+    if (std::isnan((*params)[param.first])) {
+      *why = "missing parameter " + param.first;
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * Designs the filter of a front end or resampler, from its cutoff and
+ * number of taps or, if it has a stop parameter, from its specification:
+ * an equiripple filter, or a Kaiser-windowed one with kaiser=1.
+ * @param given The parameters in the statement.
+ * @param params All the parameters, with their defaults.
+ * @param rate The sample rate of the filter's input.
+ * @param cutoff The cutoff to use if none is given.
+ * @param coefficients Where to put the filter's coefficients.
+ * @param why Where to say what is wrong.
+ * @return Whether the parameters are valid.
+ */
+bool designFilter(const map<string, double>& given,
+                  const map<string, double>& params, int rate, double cutoff,
+                  vector<float>* coefficients, string* why) {
+  if (!given.count("stop")) {
+    if (given.count("pass") || given.count("atten")
+        || given.count("ripple") || given.count("kaiser")) {
+      *why = "pass, atten, ripple and kaiser need stop";
+      return false;
+    }
+    if (given.count("cutoff")) {
+      cutoff = params.at("cutoff");
+    }
+    if (cutoff <= 0 || cutoff >= rate / 2.0) {
+      *why = "the cutoff must be between 0 and half the rate, "
+          + to_string(rate / 2) + " Hz";
+      return false;
+    }
+    if (params.at("taps") < 1 || params.at("taps") > kMaxTaps) {
+      *why = "the number of taps must be between 1 and "
+          + to_string(kMaxTaps);
+      return false;
+    }
+    *coefficients = getLowPassFIRCoeffs(rate, cutoff, params.at("taps"));
+    return true;
+  }
+  if (given.count("cutoff") || given.count("taps")) {
+    *why = "stop can't be used with cutoff or taps";
+    return false;
+  }
+  if (params.at("pass") < 0 || params.at("pass") >= params.at("stop")
+      || params.at("atten") <= 0 || params.at("ripple") <= 0) {
+    *why = "the passband must end before the stopband, with a positive "
+        "attenuation and ripple";
+    return false;
+  }
+  if (params.at("stop") >= rate / 2.0) {
+    *why = "the stopband must start below half the rate, "
+        + to_string(rate / 2) + " Hz";
+    return false;
+  }
+  if (params.at("kaiser") != 0) {
+    // The window's passband ripple follows from the attenuation.
+    if (given.count("ripple")) {
+      *why = "kaiser can't be used with ripple";
+      return false;
+    }
+    *coefficients = getKaiserFIRCoeffs(rate, params.at("pass"),
+                                       params.at("stop"), params.at("atten"));
+    return true;
+  }
+  *coefficients = getEquirippleFIRCoeffs(rate, params.at("pass"),
+                                         params.at("stop"), params.at("atten"),
+                                         params.at("ripple"));
+  return true;
+}
+
+}  // namespace
+
+Flowgraph::Flowgraph(int inRate, int outRate)
+    : inRate_(inRate), outRate_(outRate), elided_(0), merged_(0) {}
+
+Flowgraph::~Flowgraph() {}
+
+bool Flowgraph::build(const string& description) {
+  stages_.clear();
+  ports_.clear();
+  portNames_.clear();
+  outputs_.clear();
+  buffers_.clear();
+  elided_ = 0;
+  merged_ = 0;
+  ports_.push_back(Port{PORT_RAW, inRate_, 0});
+  portNames_["in"] = 0;
+
+  string text(description);
+  replace(text.begin(), text.end(), ';', '\n');
+  istringstream lines(text);
+  string statement;
+  for (int num = 1; getline(lines, statement); ++num) {
+    statement = statement.substr(0, statement.find('#'));
+    statement.erase(0, statement.find_first_not_of(" \t"));
+    statement.erase(statement.find_last_not_of(" \t") + 1);
+    if (!addStatement(statement)) {
+      ostringstream why;
+      why << "statement " << num << " (" << statement << "): " << error_;
+      error_ = why.str();
+      return false;
+    }
+  }
+  if (outputs_.empty()) {
+    error_ = "the graph has no output";
+    return false;
+  }
+  optimize();
+  allocateBuffers();
+  error_.clear();
+  return true;
+}
+
+bool Flowgraph::load(const string& path) {
+  ifstream in(path.c_str());
+  if (!in) {
+    error_ = "could not open " + path;
+    return false;
+  }
+  ostringstream description;
+  description << in.rdbuf();
+  if (!build(description.str())) {
+    error_ = path + ": " + error_;
+    return false;
+  }
+  return true;
+}
+
+bool Flowgraph::addStatement(const string& statement) {
+  istringstream words(statement);
+  vector<string> tokens;
+  string word;
+  while (words >> word) {
+    tokens.push_back(word);
+  }
+  if (tokens.empty()) {
+    return true;
+  }
+  string name;
+  int first = 0;
+  if (tokens.size() >= 2 && tokens[1] == "=") {
+    name = tokens[0];
+    first = 2;
+  }
+  if (first >= tokens.size()) {
+    error_ = "missing stage type";
+    return false;
+  }
+  string type = tokens[first];
+  vector<int> inputs;
+  map<string, double> given;
+  for (int i = first + 1; i < tokens.size(); ++i) {
+    size_t equals = tokens[i].find('=');
+    if (equals != string::npos) {
+      istringstream value(tokens[i].substr(equals + 1));
+      double number;
+      if (!(value >> number) || !value.eof()) {
+        error_ = "bad value in " + tokens[i];
+        return false;
+      }
+      given[tokens[i].substr(0, equals)] = number;
+    } else if (portNames_.count(tokens[i])) {
+      inputs.push_back(portNames_[tokens[i]]);
+    } else {
+      error_ = "unknown port " + tokens[i];
+      return false;
+    }
+  }
+
+  // Checks the inputs against the stage type.
+  PortType inType = PORT_REAL;
+  int minInputs = 1;
+  int maxInputs = 1;
+  if (type == "frontend") {
+    inType = PORT_RAW;
+  } else if (type == "am" || type == "fm") {
+    inType = PORT_IQ;
+  } else if (type == "matrix") {
+    minInputs = 2;
+    maxInputs = 2;
+  } else if (type == "output") {
+    maxInputs = 2;
+  } else if (type != "resample" && type != "deemph" && type != "gain"
+             && type != "stereo") {
+    error_ = "unknown stage type " + type;
+    return false;
+  }
+  if (inputs.size() < minInputs || inputs.size() > maxInputs) {
+    error_ = type + " takes " + to_string(minInputs)
+        + (minInputs == maxInputs ? "" : " or " + to_string(maxInputs))
+        + " input(s)";
+    return false;
+  }
+  int rate = ports_[inputs[0]].rate;
+  for (int input : inputs) {
+    if (ports_[input].type != inType) {
+      error_ = "wrong input type for " + type;
+      return false;
+    }
+    if (ports_[input].rate != rate) {
+      error_ = "the inputs of " + type + " are at different rates";
+      return false;
+    }
+  }
+
+  if (type == "output") {
+    if (!name.empty() || !given.empty() || !outputs_.empty()) {
+      error_ = "there must be one output, without a name or parameters";
+      return false;
+    }
+    if (rate != outRate_) {
+      error_ = "the output is at " + to_string(rate) + " Hz instead of "
+          + to_string(outRate_);
+      return false;
+    }
+    outputs_ = inputs;
+    return true;
+  }
+  if (name.empty() || name.find('.') != string::npos
+      || portNames_.count(name)) {
+    error_ = "a stage needs a new name without dots";
+    return false;
+  }
+
+  // Creates the stage, or makes its name stand for its input if it would
+  // do nothing.
+  map<string, double> params;
+  Stage* stage = 0;
+  vector<string> portNames{"out"};
+  PortType outType = PORT_REAL;
+  int outRate = rate;
+  if (type == "frontend") {
+    if (!takeParams(given, {{"rate", kRequired}, {"cutoff", 0},
+                            {"taps", kFrontEndTaps}, {"pass", 0},
+                            {"stop", 0}, {"atten", kAttenuation},
+                            {"ripple", kRipple}, {"kaiser", 0}}, &params,
+                    &error_)) {
+      return false;
+    }
+    if (!given.count("cutoff") && !given.count("stop")) {
+      error_ = "missing parameter cutoff or stop";
+      return false;
+    }
+    outRate = params["rate"];
+    if (outRate <= 0 || outRate > rate) {
+      error_ = "the channel rate must be positive and at most the input's";
+      return false;
+    }
+    vector<float> coefs;
+    if (!designFilter(given, params, rate, 0, &coefs, &error_)) {
+      return false;
+    }
+    stage = new FrontEndStage(rate, outRate, coefs);
+    portNames[0] = "iq";
+    outType = PORT_IQ;
+  } else if (type == "am") {
+    if (!takeParams(given, {}, &params, &error_)) {
+      return false;
+    }
+    stage = new DetectorStage<AMDetector>(AMDetector());
+  } else if (type == "fm") {
+    if (!takeParams(given, {{"maxf", kMaxF}}, &params, &error_)) {
+      return false;
+    }
+    if (params["maxf"] <= 0) {
+      error_ = "the maximum deviation must be positive";
+      return false;
+    }
+    stage = new DetectorStage<FMDiscriminator>(
+        FMDiscriminator(rate, params["maxf"]));
+  } else if (type == "resample") {
+    if (!takeParams(given, {{"rate", outRate_}, {"cutoff", 0},
+                            {"taps", kAudioTaps}, {"pass", 0}, {"stop", 0},
+                            {"atten", kAttenuation}, {"ripple", kRipple},
+                            {"kaiser", 0}}, &params, &error_)) {
+      return false;
+    }
+    outRate = params["rate"];
+    if (outRate <= 0 || outRate > rate) {
+      error_ = "resample can only lower the rate";
+      return false;
+    }
+    vector<float> coefs;
+    if (!designFilter(given, params, rate,
+                      min(kAudioCutoff * 1.0, 0.45 * outRate), &coefs,
+                      &error_)) {
+      return false;
+    }
+    stage = new ResampleStage(rate, outRate, coefs);
+  } else if (type == "deemph") {
+    if (!takeParams(given, {{"tc", kDeemphTc}}, &params, &error_)) {
+      return false;
+    }
+    if (params["tc"] < 0) {
+      error_ = "the time constant can't be negative";
+      return false;
+    }
+    if (params["tc"] != 0) {
+      stage = new DeemphStage(rate, params["tc"]);
+    }
+  } else if (type == "gain") {
+    if (!takeParams(given, {{"db", 0}}, &params, &error_)) {
+      return false;
+    }
+    if (params["db"] != 0) {
+      stage = new GainStage(pow(10, params["db"] / 20));
+    }
+  } else if (type == "stereo") {
+    if (!takeParams(given, {{"pilot", kPilotFreq}}, &params, &error_)) {
+      return false;
+    }
+    if (params["pilot"] <= 0 || params["pilot"] >= rate / 2.0) {
+      error_ = "the pilot must be between 0 and half the rate, "
+          + to_string(rate / 2) + " Hz";
+      return false;
+    }
+    stage = new StereoStage(rate, params["pilot"]);
+    portNames[0] = "diff";
+  } else if (type == "matrix") {
+    if (!takeParams(given, {}, &params, &error_)) {
+      return false;
+    }
+    stage = new MatrixStage();
+    portNames = {"left", "right"};
+  }
+
+  if (!stage) {
+    portNames_[name] = inputs[0];
+    portNames_[name + "." + portNames[0]] = inputs[0];
+    ++elided_;
+    return true;
+  }
+  stage->inputs = inputs;
+  for (const string& portName : portNames) {
+    int port = ports_.size();
+    ports_.push_back(Port{outType, outRate, -1});
+    if (stage->outputs.empty()) {
+      portNames_[name] = port;
+    }
+    portNames_[name + "." + portName] = port;
+    stage->outputs.push_back(port);
+  }
+  stages_.emplace_back(stage);
+  return true;
+}
+
+void Flowgraph::optimize() {
+  // Drops the stages whose outputs nobody reads.
+  vector<int> readers(ports_.size(), 0);
+  for (int port : outputs_) {
+    ++readers[port];
+  }
+  vector<unique_ptr<Stage> > live;
+  for (int s = stages_.size() - 1; s >= 0; --s) {
+    bool used = false;
+    for (int port : stages_[s]->outputs) {
+      used |= readers[port] > 0;
+    }
+    if (!used) {
+      ++elided_;
+      continue;
+    }
+    for (int port : stages_[s]->inputs) {
+      ++readers[port];
+    }
+    live.push_back(move(stages_[s]));
+  }
+  reverse(live.begin(), live.end());
+  stages_.swap(live);
+
+  // Merges a stage into the one that reads its output, when nothing else
+  // does, until there is nothing left to merge. The merged stage takes the
+  // place of the second, after the first one's inputs.
+  vector<int> producers(ports_.size(), -1);
+  for (int s = 0; s < stages_.size(); ++s) {
+    if (stages_[s]->inputs.size() != 1) {
+      continue;
+    }
+    int port = stages_[s]->inputs[0];
+    for (int p = 0; p < s; ++p) {
+      for (int output : stages_[p]->outputs) {
+        producers[output] = p;
+      }
+    }
+    int first = producers[port];
+    if (first < 0 || readers[port] != 1
+        || stages_[first]->outputs.size() != 1) {
+      continue;
+    }
+    Stage* merged = mergeStages(stages_[first].get(), stages_[s].get());
+    if (!merged) {
+      continue;
+    }
+    merged->inputs = stages_[first]->inputs;
+    merged->outputs = stages_[s]->outputs;
+    stages_[s].reset(merged);
+    stages_.erase(stages_.begin() + first);
+    ++merged_;
+    // Looks at the merged stage again, which is now one place earlier.
+    s -= 2;
+  }
+}
+
+void Flowgraph::allocateBuffers() {
+  vector<int> readers(ports_.size(), 0);
+  for (int port : outputs_) {
+    ++readers[port];
+  }
+  for (auto& stage : stages_) {
+    for (int port : stage->inputs) {
+      ++readers[port];
+    }
+  }
+
+  // Gives each output port the buffer of the input it replaces, a buffer
+  // whose last reader has run, or a new one. The input's buffer is the
+  // caller's, and the graph's outputs are read after the last stage.
+  int count = 1;
+  vector<int> available;
+  for (auto& stage : stages_) {
+    vector<int> taken;
+    for (int k = 0; k < stage->outputs.size(); ++k) {
+      int buffer = -1;
+      if (stage->inPlace() && k < stage->inputs.size()) {
+        int input = stage->inputs[k];
+        if (readers[input] == 1 && ports_[input].buffer != 0) {
+          buffer = ports_[input].buffer;
+        }
+      }
+      if (buffer < 0 && !available.empty()) {
+        buffer = available.back();
+        available.pop_back();
+      } else if (buffer < 0) {
+        buffer = count++;
+      }
+      ports_[stage->outputs[k]].buffer = buffer;
+      taken.push_back(buffer);
+    }
+    for (int input : stage->inputs) {
+      int buffer = ports_[input].buffer;
+      if (--readers[input] == 0 && buffer != 0
+          && find(taken.begin(), taken.end(), buffer) == taken.end()) {
+        available.push_back(buffer);
+      }
+    }
+  }
+
+  buffers_.assign(count, Buffer{0, SamplesIQ(), Samples(), false});
+  for (auto& stage : stages_) {
+    for (int port : stage->inputs) {
+      stage->in.push_back(&buffers_[ports_[port].buffer]);
+    }
+    for (int port : stage->outputs) {
+      stage->out.push_back(&buffers_[ports_[port].buffer]);
+    }
+  }
+}
+
+StereoAudio Flowgraph::decode(const Samples& samples, bool inStereo) {
+  buffers_[0].raw = &samples;
+  StereoAudio output;
+  output.carrier = false;
+  output.inStereo = false;
+  for (auto& stage : stages_) {
+    bool silent = false;
+    for (Buffer* in : stage->in) {
+      silent |= in->silent;
+    }
+    for (Buffer* out : stage->out) {
+      out->silent = silent;
+    }
+    if (silent) {
+      stage->silence();
+    } else {
+      stage->process(inStereo);
+    }
+    output.carrier |= stage->hasCarrier();
+    output.inStereo |= stage->hasPilot();
+  }
+  output.left = buffers_[ports_[outputs_[0]].buffer].real;
+  output.right = buffers_[ports_[outputs_.back()].buffer].real;
+  return output;
+}
+
+double Flowgraph::groupDelay() {
+  // The delay of each port is that of its slowest input plus the stage's.
+  vector<double> delays(ports_.size(), 0);
+  for (auto& stage : stages_) {
+    double delay = 0;
+    for (int port : stage->inputs) {
+      delay = max(delay, delays[port]);
+    }
+    delay += stage->delay();
+    for (int port : stage->outputs) {
+      delays[port] = delay;
+    }
+  }
+  double delay = 0;
+  for (int port : outputs_) {
+    delay = max(delay, delays[port]);
+  }
+  return delay;
+}
+
+void Flowgraph::setSquelch(float level, float hysteresis) {
+  for (auto& stage : stages_) {
+    if (stage->frontEnd()) {
+      stage->frontEnd()->setSquelch(level, hysteresis);
+    }
+  }
+}
+
+void Flowgraph::setMinimumPhase() {
+  // As in WBFMDecoder, the front ends keep their linear phase when there
+  // is a stereo subcarrier to decode.
+  bool stereo = false;
+  for (auto& stage : stages_) {
+    stereo |= dynamic_cast<StereoStage*>(stage.get()) != 0;
+  }
+  for (auto& stage : stages_) {
+    if (!stereo || !stage->frontEnd()) {
+      stage->makeMinimumPhase();
+    }
+  }
+}
+
+bool Flowgraph::squelched() {
+  for (auto& stage : stages_) {
+    if (stage->frontEnd() && !stage->frontEnd()->squelched()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace radioreceiver
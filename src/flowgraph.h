@@ -0,0 +1,171 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * A decoder assembled at runtime from a description of its stages.
+ */
+
+#ifndef FLOWGRAPH_H_
+#define FLOWGRAPH_H_
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "decoder.h"
+#include "dsp.h"
+
+using namespace std;
+
+namespace radioreceiver {
+
+/**
+ * A decoder made of named stages connected through typed ports, built from
+ * a text description instead of being written as a class.
+ *
+ * The description is a list of statements separated by newlines or ';',
+ * where '#' starts a comment. Each statement creates a stage:
+ *
+ *     NAME = TYPE INPUT... KEY=VALUE...
+ *
+ * An input is the name of an earlier stage, for its first output, or
+ * NAME.PORT for another one; the raw input samples are called "in". The
+ * audio is taken from the statement "output LEFT [RIGHT]", whose ports
+ * must be at the decoder's output rate. The stage types are:
+ *
+ *     frontend in rate=HZ cutoff=HZ [taps=351]  -> iq
+ *     am IQ                                     -> out
+ *     fm IQ [maxf=10000]                        -> out
+ *     resample REAL [rate=OUT] [cutoff=HZ] [taps=41]  -> out
+ *     deemph REAL [tc=50]                       -> out
+ *     gain REAL [db=0]                          -> out
+ *     stereo REAL [pilot=19000]                 -> diff
+ *     matrix MONO DIFF                          -> left, right
+ *
+ * The resampler's cutoff defaults to 10 kHz, or 0.45 times the output rate
+ * if that is lower. Instead of a cutoff and taps, a front end or resampler
+ * can be given stop=HZ [pass=0] [atten=70] [ripple=0.1], the edges of its
+ * stopband and passband, the stopband's attenuation and the passband's
+ * ripple in dB, and then gets the shortest equiripple filter that meets
+ * them.
+ *
+ * Stages that would leave their input unchanged (a resampler to the same
+ * rate with a cutoff or stopband at or above its Nyquist frequency, a
+ * de-emphasis with tc=0, a gain of 0 dB) and stages whose outputs are
+ * never read are left out of the schedule. Linear stages in a row are
+ * merged: gains are folded into each other and into resamplers, and two
+ * resamplers become one when the merged filter needs fewer taps per second
+ * and reads the same input samples, which takes the first one keeping the
+ * rate or both ratios being integers. All the buffers are allocated when
+ * the graph is built, and a stage that can work in place writes over its
+ * input when nothing else reads it afterwards.
+ */
+class Flowgraph : public Decoder {
+ public:
+  /** The kinds of data a port carries. */
+  enum PortType { PORT_RAW, PORT_IQ, PORT_REAL };
+
+  /** The data flowing through a port, reused for every block. */
+  struct Buffer {
+    const Samples* raw;
+    SamplesIQ iq;
+    Samples real;
+    /** Whether the block was silenced by a front end's squelch. */
+    bool silent;
+  };
+
+  class Stage;
+
+ private:
+  struct Port {
+    PortType type;
+    int rate;
+    int buffer;
+  };
+
+  int inRate_;
+  int outRate_;
+  vector<unique_ptr<Stage> > stages_;
+  vector<Port> ports_;
+  map<string, int> portNames_;
+  vector<int> outputs_;
+  vector<Buffer> buffers_;
+  int elided_;
+  int merged_;
+  string error_;
+
+  bool addStatement(const string& statement);
+  void optimize();
+  void allocateBuffers();
+
+ public:
+  /**
+   * Constructor for an empty graph.
+   * @param inRate The sample rate of the input.
+   * @param outRate The sample rate of the audio.
+   */
+  Flowgraph(int inRate, int outRate);
+  ~Flowgraph();
+
+  /**
+   * Builds the graph from a description.
+   * @param description The statements that define the graph.
+   * @return Whether the description is valid; error() tells why not.
+   */
+  bool build(const string& description);
+
+  /**
+   * Builds the graph from a file holding a description.
+   * @param path The file's path.
+   * @return Whether the file could be read and is valid; error() tells why
+   *     not.
+   */
+  bool load(const string& path);
+
+  /**
+   * Returns why the last build() or load() failed.
+   */
+  const string& error() const { return error_; }
+
+  /**
+   * Returns the number of stages that run for each block.
+   */
+  int stageCount() const { return stages_.size(); }
+
+  /**
+   * Returns the number of stages left out because they do nothing.
+   */
+  int elidedCount() const { return elided_; }
+
+  /**
+   * Returns the number of stages merged into the next one.
+   */
+  int mergedCount() const { return merged_; }
+
+  /**
+   * Returns the number of buffers shared by the ports.
+   */
+  int bufferCount() const { return buffers_.size(); }
+
+  virtual StereoAudio decode(const Samples& samples, bool inStereo);
+  virtual double groupDelay();
+  virtual void setSquelch(float level, float hysteresis);
+  virtual void setMinimumPhase();
+  virtual bool squelched();
+};
+
+}  // namespace radioreceiver
+
+#endif  // FLOWGRAPH_H_
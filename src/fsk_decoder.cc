@@ -0,0 +1,153 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * Receives samples captured by the tuner, demodulates a binary FSK signal,
+ * recovers its symbol clock, and returns the symbols.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include "dsp.h"
+#include "fsk_decoder.h"
+#include "stats.h"
+
+using namespace std;
+
+namespace radioreceiver {
+
+// The fraction of the timing error corrected at each symbol.
+const float kTimingGain = 0.2;
+// The weight of each symbol in the average of the signal level.
+const float kLevelWeight = 0.01;
+// The stopband attenuation and passband ripple of the channel filter, in
+// dB, the same as the other decoders'.
+const float kAttenuation = 70;
+const float kRipple = 0.1;
+// How far the channel filter's passband ends below the edge of the signal
+// (the deviation plus half the symbol rate) and its stopband starts above
+// it, in Hz.
+const float kChannelPassBelow = 5000;
+const float kChannelStopAbove = 7000;
+
+/**
+ * Designs the channel filter of the front end.
+ * @param inRate The sample rate of the input.
+ * @param edge The frequency the transition band is placed around.
+ * @return The filter's coefficients.
+ */
+static vector<float> channelFilter(int inRate, float edge) {
+  float passFreq = max<float>(0, edge - kChannelPassBelow);
+  return getEquirippleFIRCoeffs(inRate, passFreq, edge + kChannelStopAbove,
+                                kAttenuation, kRipple);
+}
+
+FSKDecoder::FSKDecoder(int inRate, int baudRate, int maxF)
+    : inRate_(inRate),
+      baudRate_(baudRate),
+      demodulator_(inRate, kSamplesPerSymbol * baudRate, maxF,
+                   channelFilter(inRate, maxF + baudRate / 2)),
+      matchHistory_(kSamplesPerSymbol, 0),
+      matchIndex_(0),
+      matchSum_(0),
+      next_(kSamplesPerSymbol),
+      last_(0),
+      level_(1),
+      descramble_(false),
+      descrambler_(0),
+      minimumPhase_(false) {}
+
+StereoAudio FSKDecoder::decode(const Samples& samples, bool inStereo) {
+  Samples demodulated(demodulator_.demodulateTuned(samples));
+
+  StereoAudio output;
+  output.inStereo = false;
+  output.carrier = demodulator_.hasCarrier();
+  StageTimer timer(STAGE_RESAMPLER, demodulated.size());
+
+  // A moving sum over one symbol is the matched filter for rectangular
+  // symbols.
+  for (int i = 0; i < demodulated.size(); ++i) {
+    matchSum_ += demodulated[i] - matchHistory_[matchIndex_];
+    matchHistory_[matchIndex_] = demodulated[i];
+    matchIndex_ = (matchIndex_ + 1) % kSamplesPerSymbol;
+    filtered_.push_back(matchSum_ / kSamplesPerSymbol);
+  }
+
+  Samples& symbols = output.left;
+  float halfSymbol = kSamplesPerSymbol / 2.0;
+  while (next_ + 1 < filtered_.size()) {
+    int pos = next_;
+    float frac = next_ - pos;
+    float value = filtered_[pos] + frac * (filtered_[pos + 1] - filtered_[pos]);
+    double midPoint = next_ - halfSymbol;
+    pos = midPoint;
+    frac = midPoint - pos;
+    float middle = filtered_[pos] + frac * (filtered_[pos + 1] - filtered_[pos]);
+
+    // Gardner detector: on a transition, the sample halfway between two
+    // symbols is zero when the timing is right, and has the sign of the
+    // new symbol when the sampling is late.
+    float error = (last_ - value) * middle / (level_ * level_ + 1e-6f);
+    error = max(-1.0f, min(1.0f, error));
+    level_ += (fabs(value) - level_) * kLevelWeight;
+    next_ += kSamplesPerSymbol + kTimingGain * error * halfSymbol / 2;
+    last_ = value;
+
+    if (descramble_) {
+      int bit = value > 0;
+      int flip = ((descrambler_ >> 11) ^ (descrambler_ >> 16)) & 1;
+      descrambler_ = (descrambler_ << 1) | bit;
+      if (flip) {
+        value = -value;
+      }
+    }
+    symbols.push_back(value / level_);
+  }
+
+  // Keep what the next symbol's interpolation needs.
+  int consumed = (int) (next_ - kSamplesPerSymbol) - 1;
+  if (consumed > 0) {
+    filtered_.erase(filtered_.begin(), filtered_.begin() + consumed);
+    next_ -= consumed;
+  }
+  output.right = output.left;
+  return output;
+}
+
+double FSKDecoder::groupDelay() {
+  return demodulator_.delay() / inRate_
+      + (kSamplesPerSymbol - 1) / 2.0 / (kSamplesPerSymbol * baudRate_);
+}
+
+void FSKDecoder::setSquelch(float level, float hysteresis) {
+  demodulator_.setSquelch(level, hysteresis);
+}
+
+void FSKDecoder::setMinimumPhase() {
+  if (minimumPhase_) {
+    return;
+  }
+  minimumPhase_ = true;
+  demodulator_.frontEnd().makeMinimumPhase();
+}
+
+bool FSKDecoder::squelched() {
+  return demodulator_.squelched();
+}
+
+}  // namespace radioreceiver
@@ -0,0 +1,99 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * Receives samples captured by the tuner, demodulates a binary FSK signal,
+ * recovers its symbol clock, and returns the symbols.
+ */
+
+#ifndef FSK_DECODER_H_
+#define FSK_DECODER_H_
+
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+#include "decoder.h"
+#include "dsp.h"
+
+using namespace std;
+
+namespace radioreceiver {
+
+/**
+ * A decoder for a binary FSK sample stream, such as 1200 or 9600 baud
+ * packet radio. The signal is demodulated as NBFM at eight samples per
+ * symbol, passed through a filter matched to rectangular symbols, and
+ * sampled at the symbol centers found by a Gardner timing error detector.
+ */
+class FSKDecoder : public Decoder {
+  static const int kSamplesPerSymbol = 8;
+
+  int inRate_;
+  int baudRate_;
+  FMDemodulator demodulator_;
+  Samples matchHistory_;
+  int matchIndex_;
+  float matchSum_;
+  Samples filtered_;
+  double next_;
+  float last_;
+  float level_;
+  bool descramble_;
+  uint32_t descrambler_;
+  bool minimumPhase_;
+
+ public:
+  /**
+   * Constructor for the decoder.
+   * @param inRate The sample rate for the input sample stream.
+   * @param baudRate The symbol rate.
+   * @param maxF The frequency deviation of the symbols.
+   */
+  FSKDecoder(int inRate, int baudRate, int maxF);
+
+  /**
+   * Enables the G3RUH (x^17 + x^12 + 1) descrambler used by 9600 baud
+   * packet radio.
+   * @param descramble Whether to descramble the symbols.
+   */
+  void setDescramble(bool descramble) { descramble_ = descramble; }
+
+  /**
+   * Demodulates a block of floating-point samples and recovers its
+   * symbols.
+   * @param samples The samples to decode.
+   * @param inStereo Ignored.
+   * @return The left and right channels both hold one soft decision per
+   *     symbol, around +1 for a 1 and -1 for a 0.
+   */
+  virtual StereoAudio decode(const Samples& samples, bool inStereo);
+
+  virtual double groupDelay();
+
+  virtual void setSquelch(float level, float hysteresis);
+
+  /**
+   * Makes the channel filter minimum-phase. The matched filter, a moving
+   * sum, has all its zeros on the unit circle, so it is its own
+   * minimum-phase equivalent and stays as it is.
+   */
+  virtual void setMinimumPhase();
+
+  virtual bool squelched();
+};
+
+}  // namespace radioreceiver
+
+#endif  // FSK_DECODER_H_
@@ -0,0 +1,119 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * Extraction of HDLC frames, such as AX.25 packets, from a bit stream.
+ */
+
+#include <stdint.h>
+#include <vector>
+
+#include "hdlc.h"
+
+using namespace std;
+
+namespace radioreceiver {
+
+const uint8_t kKissFend = 0xc0;
+const uint8_t kKissFesc = 0xdb;
+const uint8_t kKissTfend = 0xdc;
+const uint8_t kKissTfesc = 0xdd;
+
+uint16_t crc16X25(const uint8_t* data, int length) {
+  uint16_t crc = 0xffff;
+  for (int i = 0; i < length; ++i) {
+    crc ^= data[i];
+    for (int b = 0; b < 8; ++b) {
+      crc = (crc & 1) ? (crc >> 1) ^ 0x8408 : crc >> 1;
+    }
+  }
+  return crc ^ 0xffff;
+}
+
+void kissEncode(const vector<uint8_t>& frame, vector<char>* out) {
+  out->push_back(kKissFend);
+  out->push_back(0);
+  for (uint8_t byte : frame) {
+    if (byte == kKissFend) {
+      out->push_back(kKissFesc);
+      out->push_back(kKissTfend);
+    } else if (byte == kKissFesc) {
+      out->push_back(kKissFesc);
+      out->push_back(kKissTfesc);
+    } else {
+      out->push_back(byte);
+    }
+  }
+  out->push_back(kKissFend);
+}
+
+HdlcDeframer::HdlcDeframer(int minLength, int maxLength)
+    : minLength_(minLength), maxLength_(maxLength), lastBit_(0), ones_(0),
+      frames_(0), badFrames_(0) {}
+
+void HdlcDeframer::process(const Samples& symbols,
+                           vector<vector<uint8_t> >* frames) {
+  for (float symbol : symbols) {
+    // NRZI: a 0 is sent as a change of level, a 1 as no change.
+    int bit = symbol > 0;
+    addBit(bit == lastBit_, frames);
+    lastBit_ = bit;
+  }
+}
+
+void HdlcDeframer::addBit(int bit, vector<vector<uint8_t> >* frames) {
+  if (bit) {
+    if (++ones_ > 6) {
+      // An abort, or an idle line.
+      bits_.clear();
+    } else {
+      bits_.push_back(1);
+    }
+    return;
+  }
+  if (ones_ == 6) {
+    // A flag, whose first seven bits were taken for data.
+    bits_.resize(bits_.size() >= 7 ? bits_.size() - 7 : 0);
+    endFrame(frames);
+    bits_.clear();
+  } else if (ones_ != 5) {
+    // After five ones, a zero is a stuffed bit to be dropped.
+    bits_.push_back(0);
+  }
+  ones_ = 0;
+  if (bits_.size() > 8 * maxLength_ + 8) {
+    bits_.clear();
+  }
+}
+
+void HdlcDeframer::endFrame(vector<vector<uint8_t> >* frames) {
+  int length = bits_.size() / 8;
+  if (bits_.size() % 8 != 0 || length < minLength_ || length > maxLength_) {
+    return;
+  }
+  vector<uint8_t> frame(length, 0);
+  for (int i = 0; i < bits_.size(); ++i) {
+    frame[i / 8] |= bits_[i] << (i % 8);
+  }
+  uint16_t fcs = frame[length - 2] | (frame[length - 1] << 8);
+  if (crc16X25(frame.data(), length - 2) != fcs) {
+    ++badFrames_;
+    return;
+  }
+  frame.resize(length - 2);
+  frames->push_back(frame);
+  ++frames_;
+}
+
+}  // namespace radioreceiver
@@ -0,0 +1,96 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * Extraction of HDLC frames, such as AX.25 packets, from a bit stream.
+ */
+
+#ifndef HDLC_H_
+#define HDLC_H_
+
+#include <stdint.h>
+#include <vector>
+
+#include "dsp.h"
+
+using namespace std;
+
+namespace radioreceiver {
+
+/**
+ * Computes the CRC-16 used as the frame check sequence in HDLC and AX.25
+ * (CCITT polynomial, reflected, initial value and final XOR 0xFFFF).
+ * @param data The bytes to check.
+ * @param length The number of bytes.
+ * @return The CRC, which is sent least significant byte first.
+ */
+uint16_t crc16X25(const uint8_t* data, int length);
+
+/**
+ * Appends a frame to a buffer in KISS format, as a data frame for port 0.
+ * @param frame The frame's contents, without the frame check sequence.
+ * @param out The buffer to append to.
+ */
+void kissEncode(const vector<uint8_t>& frame, vector<char>* out);
+
+/**
+ * Finds the HDLC frames in an NRZI encoded bit stream: it decodes the
+ * NRZI, looks for the flags, removes the stuffed bits and checks the
+ * frame check sequence.
+ */
+class HdlcDeframer {
+  int minLength_;
+  int maxLength_;
+  int lastBit_;
+  int ones_;
+  vector<uint8_t> bits_;
+  int64_t frames_;
+  int64_t badFrames_;
+
+  void addBit(int bit, vector<vector<uint8_t> >* frames);
+  void endFrame(vector<vector<uint8_t> >* frames);
+
+ public:
+  /**
+   * Constructor for the deframer.
+   * @param minLength The length in bytes, including the frame check
+   *     sequence, below which frames are ignored. The default is the
+   *     shortest AX.25 frame.
+   * @param maxLength The length in bytes above which frames are ignored.
+   */
+  HdlcDeframer(int minLength = 17, int maxLength = 512);
+
+  /**
+   * Processes a block of bits.
+   * @param symbols One decision per bit, positive for a 1.
+   * @param frames The vector to append the valid frames found to, without
+   *     their frame check sequence.
+   */
+  void process(const Samples& symbols, vector<vector<uint8_t> >* frames);
+
+  /**
+   * Returns the number of valid frames found.
+   */
+  int64_t frames() const { return frames_; }
+
+  /**
+   * Returns the number of frames rejected because of a bad frame check
+   * sequence.
+   */
+  int64_t badFrames() const { return badFrames_; }
+};
+
+}  // namespace radioreceiver
+
+#endif  // HDLC_H_
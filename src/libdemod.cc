@@ -0,0 +1,248 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * C interface of libdemod.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+#include "am_decoder.h"
+#include "decoder.h"
+#include "dsp.h"
+#include "fsk_decoder.h"
+#include "libdemod.h"
+#include "nbfm_decoder.h"
+#include "wbfm_decoder.h"
+
+using namespace std;
+using namespace radioreceiver;
+
+namespace {
+
+// The size in bytes of a complex sample in each input type.
+const int kSampleBytes[] = { 2, 4, 8 };
+
+// How far below the threshold the power must fall for the squelch to
+// close, in dB; the same as demod's.
+const float kSquelchHysteresis = 3;
+
+Decoder* makeDecoder(const demod_config& cfg) {
+  switch (cfg.modulation) {
+  case DEMOD_AM:
+    return new AMDecoder(cfg.in_rate, cfg.out_rate, cfg.bandwidth);
+  case DEMOD_WBFM:
+    return new WBFMDecoder(cfg.in_rate, cfg.out_rate);
+  case DEMOD_NBFM:
+    return new NBFMDecoder(cfg.in_rate, cfg.out_rate, cfg.max_f);
+  case DEMOD_FSK: {
+    FSKDecoder* decoder = new FSKDecoder(cfg.in_rate, cfg.baud_rate,
+                                         cfg.max_f);
+    decoder->setDescramble(cfg.descramble);
+    return decoder;
+  }
+  }
+  return 0;
+}
+
+}  // namespace
+
+struct demod_decoder {
+  demod_config config;
+  unique_ptr<Decoder> decoder;
+  unique_ptr<NCO> nco;
+  unique_ptr<IQCorrector> corrector;
+  /** The bytes of an incomplete sample left over by the last push. */
+  vector<uint8_t> partial;
+  Samples left;
+  Samples right;
+  /** The number of frames already pulled from the front of left/right. */
+  size_t pulled;
+  bool carrier;
+  bool stereo;
+};
+
+extern "C" {
+
+int demod_api_version(void) {
+  return DEMOD_API_VERSION;
+}
+
+void demod_config_init(demod_config* config, int modulation) {
+  memset(config, 0, sizeof(*config));
+  config->size = sizeof(*config);
+  config->modulation = modulation;
+  config->input_type = DEMOD_INPUT_I16;
+  config->in_rate = 1024000;
+  config->out_rate = 48000;
+  config->max_f = 10000;
+  config->bandwidth = 10000;
+  config->baud_rate = 9600;
+  config->stereo = 1;
+}
+
+demod_decoder* demod_create(const demod_config* config) {
+  if (!config || config->size < offsetof(demod_config, input_type)) {
+    return 0;
+  }
+  // The fields the caller doesn't know about keep their defaults.
+  demod_config cfg;
+  demod_config_init(&cfg, config->modulation);
+  memcpy(&cfg, config, min(config->size, sizeof(cfg)));
+  cfg.size = sizeof(cfg);
+  // Only the fields the modulation uses are checked.
+  bool usesMaxF = cfg.modulation == DEMOD_NBFM || cfg.modulation == DEMOD_FSK;
+  if (cfg.input_type < DEMOD_INPUT_U8 || cfg.input_type > DEMOD_INPUT_F32
+      || cfg.in_rate <= 0 || cfg.out_rate <= 0 || cfg.in_rate < cfg.out_rate
+      || (usesMaxF && cfg.max_f <= 0)
+      || (cfg.modulation == DEMOD_AM && cfg.bandwidth <= 0)
+      || (cfg.modulation == DEMOD_FSK
+          && (cfg.baud_rate <= 0 || cfg.baud_rate >= cfg.in_rate))) {
+    return 0;
+  }
+  // Exceptions, such as running out of memory, must not cross into C.
+  try {
+    unique_ptr<Decoder> decoder(makeDecoder(cfg));
+    if (!decoder) {
+      return 0;
+    }
+    unique_ptr<demod_decoder> out(new demod_decoder());
+    out->config = cfg;
+    out->pulled = 0;
+    out->carrier = false;
+    out->stereo = false;
+    if (cfg.squelch) {
+      decoder->setSquelch(cfg.squelch_level, kSquelchHysteresis);
+    }
+    if (cfg.low_latency) {
+      decoder->setMinimumPhase();
+    }
+    out->decoder = move(decoder);
+    if (cfg.freq_correction != 0) {
+      out->nco.reset(new NCO(cfg.in_rate, cfg.freq_correction));
+    }
+    if (cfg.iq_correct) {
+      out->corrector.reset(new IQCorrector());
+    }
+    return out.release();
+  } catch (...) {
+    return 0;
+  }
+}
+
+void demod_destroy(demod_decoder* decoder) {
+  delete decoder;
+}
+
+int demod_push(demod_decoder* decoder, const void* data, size_t length) {
+  if (!decoder || (!data && length > 0)) {
+    return -1;
+  }
+  // Exceptions, such as running out of memory, must not cross into C.
+  try {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    int sampleBytes = kSampleBytes[decoder->config.input_type];
+    // Completes a sample split across pushes by copying the whole block
+    // after it, which only happens if the caller splits samples.
+    vector<uint8_t> joined;
+    if (!decoder->partial.empty()) {
+      joined.swap(decoder->partial);
+      joined.insert(joined.end(), bytes, bytes + length);
+      bytes = joined.data();
+      length = joined.size();
+    } else if (reinterpret_cast<uintptr_t>(bytes) % (sampleBytes / 2) != 0) {
+      // A block split at an odd place can leave the values misaligned, so
+      // they are read from a copy, which is aligned.
+      joined.assign(bytes, bytes + length);
+      bytes = joined.data();
+    }
+    size_t whole = length - length % sampleBytes;
+    decoder->partial.assign(bytes + whole, bytes + length);
+    if (whole == 0) {
+      return 0;
+    }
+
+    Samples samples;
+    NCO* nco = decoder->nco.get();
+    IQCorrector* corrector = decoder->corrector.get();
+    switch (decoder->config.input_type) {
+    case DEMOD_INPUT_U8:
+      samples = samplesFromUint8(bytes, whole, nco, corrector);
+      break;
+    case DEMOD_INPUT_I16:
+      samples = samplesFromInt16(reinterpret_cast<const int16_t*>(bytes),
+                                 whole / 2, nco, corrector);
+      break;
+    case DEMOD_INPUT_F32:
+      samples = samplesFromFloat32(reinterpret_cast<const float*>(bytes),
+                                   whole / 4, nco, corrector);
+      break;
+    }
+    StereoAudio audio = decoder->decoder->decode(samples,
+                                                 decoder->config.stereo);
+    decoder->carrier = audio.carrier;
+    decoder->stereo = audio.inStereo;
+
+    // Drops the audio already pulled before appending the new one.
+    Samples& left = decoder->left;
+    Samples& right = decoder->right;
+    left.erase(left.begin(), left.begin() + decoder->pulled);
+    right.erase(right.begin(), right.begin() + decoder->pulled);
+    decoder->pulled = 0;
+    left.insert(left.end(), audio.left.begin(), audio.left.end());
+    right.insert(right.end(), audio.right.begin(), audio.right.end());
+    return 0;
+  } catch (...) {
+    return -1;
+  }
+}
+
+size_t demod_available(const demod_decoder* decoder) {
+  return decoder ? decoder->left.size() - decoder->pulled : 0;
+}
+
+size_t demod_pull(demod_decoder* decoder, float* left, float* right,
+                  size_t max_frames) {
+  if (!decoder || !left) {
+    return 0;
+  }
+  size_t count = min(max_frames, demod_available(decoder));
+  const float* from = decoder->left.data() + decoder->pulled;
+  copy(from, from + count, left);
+  if (right) {
+    from = decoder->right.data() + decoder->pulled;
+    copy(from, from + count, right);
+  }
+  decoder->pulled += count;
+  return count;
+}
+
+int demod_carrier(const demod_decoder* decoder) {
+  return decoder && decoder->carrier;
+}
+
+int demod_stereo(const demod_decoder* decoder) {
+  return decoder && decoder->stereo;
+}
+
+int demod_squelched(const demod_decoder* decoder) {
+  return decoder && decoder->decoder->squelched();
+}
+
+}  // extern "C"
@@ -0,0 +1,180 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * C interface of libdemod, for decoding in-process instead of piping the
+ * samples through the demod executable.
+ *
+ * A decoder is created from a demod_config, fed the raw samples with
+ * demod_push() straight from the caller's memory, and the audio is copied
+ * into the caller's buffers with demod_pull(). A decoder must only be used
+ * by one thread at a time; different decoders are independent.
+ *
+ * The interface is stable: functions and fields are only ever added, new
+ * fields at the end of demod_config, whose size field tells the library
+ * which fields the caller knows about.
+ */
+
+#ifndef LIBDEMOD_H_
+#define LIBDEMOD_H_
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__GNUC__)
+#define DEMOD_EXPORT __attribute__((visibility("default")))
+#else
+#define DEMOD_EXPORT
+#endif
+
+/** The version of the interface declared in this header. */
+#define DEMOD_API_VERSION 1
+
+/** The modulations, in the same order as demod's -mod flag. */
+enum {
+  DEMOD_AM = 0,
+  DEMOD_WBFM = 1,
+  DEMOD_NBFM = 2,
+  DEMOD_FSK = 3
+};
+
+/** The sample formats, in the same order as demod's -inputtype flag. */
+enum {
+  DEMOD_INPUT_U8 = 0,
+  DEMOD_INPUT_I16 = 1,
+  DEMOD_INPUT_F32 = 2
+};
+
+/**
+ * The parameters of a decoder. Initialize with demod_config_init() before
+ * changing any field, so that the size and the defaults are right.
+ */
+typedef struct demod_config {
+  /** sizeof(demod_config) in the caller's version of this header. */
+  size_t size;
+  /** One of the DEMOD_* modulations. */
+  int modulation;
+  /** One of the DEMOD_INPUT_* sample formats. */
+  int input_type;
+  /** The sample rate of the input, 1024000 by default. */
+  int in_rate;
+  /** The sample rate of the audio, 48000 by default. */
+  int out_rate;
+  /** The FM deviation for NBFM and FSK, 10000 Hz by default. */
+  int max_f;
+  /** The channel bandwidth for AM, 10000 Hz by default. */
+  int bandwidth;
+  /** The FSK symbol rate, 9600 by default. */
+  int baud_rate;
+  /** Whether to undo the G3RUH scrambling of FSK, like -descramble. */
+  int descramble;
+  /** Whether to decode WBFM stereo when there is a pilot. */
+  int stereo;
+  /** Whether to enable the squelch, like -squelch. */
+  int squelch;
+  /** The squelch threshold in dB relative to a full-scale carrier. */
+  float squelch_level;
+  /** Whether to use the minimum-phase filters of -lowlatency. */
+  int low_latency;
+  /** The frequency shift applied to the input in Hz, like -freqcorr. */
+  double freq_correction;
+  /** Whether to remove the tuner's DC offset and I/Q imbalance. */
+  int iq_correct;
+} demod_config;
+
+/** An opaque decoder. */
+typedef struct demod_decoder demod_decoder;
+
+/**
+ * Returns the version of the interface the library implements, which is
+ * at least DEMOD_API_VERSION for a library that supports this header.
+ */
+DEMOD_EXPORT int demod_api_version(void);
+
+/**
+ * Fills a configuration with the defaults of the demod executable.
+ * @param config The configuration to fill.
+ * @param modulation One of the DEMOD_* modulations.
+ */
+DEMOD_EXPORT void demod_config_init(demod_config* config, int modulation);
+
+/**
+ * Creates a decoder.
+ * @param config The decoder's parameters.
+ * @return The decoder, or NULL if the parameters are invalid or the
+ *     decoder couldn't be created.
+ */
+DEMOD_EXPORT demod_decoder* demod_create(const demod_config* config);
+
+/**
+ * Destroys a decoder created with demod_create().
+ * @param decoder The decoder, or NULL.
+ */
+DEMOD_EXPORT void demod_destroy(demod_decoder* decoder);
+
+/**
+ * Decodes a block of interleaved I/Q samples. The samples can be split
+ * into blocks anywhere, even inside a sample; the decoded audio is kept
+ * until it is pulled.
+ * @param decoder The decoder.
+ * @param data The samples, in the configured format.
+ * @param length The length of the block in bytes.
+ * @return 0, or -1 if the arguments are invalid or the block couldn't be
+ *     decoded, e.g. for lack of memory.
+ */
+DEMOD_EXPORT int demod_push(demod_decoder* decoder, const void* data,
+                            size_t length);
+
+/**
+ * Returns the number of audio frames that can be pulled. For FSK, each
+ * frame is the soft decision for one bit, positive for a 1.
+ * @param decoder The decoder.
+ */
+DEMOD_EXPORT size_t demod_available(const demod_decoder* decoder);
+
+/**
+ * Copies decoded audio into the caller's buffers, as floating-point
+ * values with a full scale of 1, and forgets it.
+ * @param decoder The decoder.
+ * @param left The buffer for the left (or only) channel.
+ * @param right The buffer for the right channel, or NULL.
+ * @param max_frames The number of frames the buffers can hold.
+ * @return The number of frames copied.
+ */
+DEMOD_EXPORT size_t demod_pull(demod_decoder* decoder, float* left,
+                               float* right, size_t max_frames);
+
+/**
+ * Tells whether there was a carrier in the last block decoded.
+ */
+DEMOD_EXPORT int demod_carrier(const demod_decoder* decoder);
+
+/**
+ * Tells whether the last block decoded was in stereo.
+ */
+DEMOD_EXPORT int demod_stereo(const demod_decoder* decoder);
+
+/**
+ * Tells whether the squelch silenced the last block decoded.
+ */
+DEMOD_EXPORT int demod_squelched(const demod_decoder* decoder);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // LIBDEMOD_H_
@@ -0,0 +1,244 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * Export of the decoder's counters in the Prometheus text format.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <poll.h>
+#include <sstream>
+#include <stdint.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+#include "metrics.h"
+
+using namespace std;
+
+namespace radioreceiver {
+
+struct MetricInfo {
+  const char* name;
+  const char* type;
+  const char* help;
+};
+
+const MetricInfo kMetrics[] = {
+  { "demod_samples_in_total", "counter", "I/Q samples read from the input." },
+  { "demod_samples_out_total", "counter", "Audio frames written." },
+  { "demod_blocks_total", "counter", "Input blocks read." },
+  { "demod_carrier_blocks_total", "counter",
+    "Blocks in which the demodulator detected a carrier." },
+  { "demod_stereo_blocks_total", "counter",
+    "Blocks decoded in stereo with the pilot tone locked." },
+  { "demod_late_blocks_total", "counter",
+    "Blocks that took longer to process than their duration." },
+  { "demod_dropped_blocks_total", "counter",
+    "Blocks discarded to catch up with the input." },
+  { "demod_input_backlog_bytes", "gauge",
+    "Bytes waiting in the input pipe or socket after the last block." }
+};
+
+// The longest the exporter thread waits before checking whether to stop.
+const int kPollMillis = 100;
+
+Metrics::Metrics() {
+  for (int i = 0; i < NUM_METRICS; ++i) {
+    values_[i].store(0);
+  }
+  for (int i = 0; i < NUM_STAGES; ++i) {
+    stageNanos_[i].store(0);
+    stageSamples_[i].store(0);
+  }
+}
+
+void Metrics::setStages(const StageStats& stats) {
+  for (int i = 0; i < NUM_STAGES; ++i) {
+    stageNanos_[i].store(stats.get(i).nanos, memory_order_relaxed);
+    stageSamples_[i].store(stats.get(i).samples, memory_order_relaxed);
+  }
+}
+
+string Metrics::format() const {
+  int64_t values[NUM_METRICS];
+  for (int i = 0; i < NUM_METRICS; ++i) {
+    values[i] = values_[i].load(memory_order_relaxed);
+  }
+  ostringstream out;
+  for (int i = 0; i < NUM_METRICS; ++i) {
+    out << "# HELP " << kMetrics[i].name << " " << kMetrics[i].help << "\n"
+        << "# TYPE " << kMetrics[i].name << " " << kMetrics[i].type << "\n"
+        << kMetrics[i].name << " " << values[i] << "\n";
+  }
+  double blocks = max(values[METRIC_BLOCKS], (int64_t) 1);
+  out << "# HELP demod_carrier_ratio Fraction of the blocks with a carrier.\n"
+      << "# TYPE demod_carrier_ratio gauge\n"
+      << "demod_carrier_ratio " << values[METRIC_CARRIER_BLOCKS] / blocks
+      << "\n"
+      << "# HELP demod_stereo_ratio Fraction of the blocks decoded in "
+      << "stereo.\n"
+      << "# TYPE demod_stereo_ratio gauge\n"
+      << "demod_stereo_ratio " << values[METRIC_STEREO_BLOCKS] / blocks
+      << "\n";
+  out << "# HELP demod_stage_seconds_total Time spent in each pipeline "
+      << "stage.\n"
+      << "# TYPE demod_stage_seconds_total counter\n";
+  for (int i = 0; i < NUM_STAGES; ++i) {
+    out << "demod_stage_seconds_total{stage=\"" << stageName(i) << "\"} "
+        << stageNanos_[i].load(memory_order_relaxed) / 1e9 << "\n";
+  }
+  out << "# HELP demod_stage_samples_total Samples consumed by each "
+      << "pipeline stage.\n"
+      << "# TYPE demod_stage_samples_total counter\n";
+  for (int i = 0; i < NUM_STAGES; ++i) {
+    out << "demod_stage_samples_total{stage=\"" << stageName(i) << "\"} "
+        << stageSamples_[i].load(memory_order_relaxed) << "\n";
+  }
+  return out.str();
+}
+
+MetricsExporter::MetricsExporter(const Metrics& metrics, const string& path,
+                                 const string& socketPath, double interval)
+    : metrics_(metrics), path_(path), socketPath_(socketPath),
+      intervalNanos_(interval * 1e9), listenFd_(-1), stop_(false) {
+  if (!socketPath_.empty()) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (socketPath_.size() >= sizeof(addr.sun_path)) {
+      error_ = "socket path too long: " + socketPath_;
+      return;
+    }
+    strcpy(addr.sun_path, socketPath_.c_str());
+    // A socket left behind by a previous run would make bind() fail, but
+    // anything else at the path is left alone.
+    struct stat st;
+    if (lstat(socketPath_.c_str(), &st) == 0) {
+      if (!S_ISSOCK(st.st_mode)) {
+        error_ = socketPath_ + ": exists and is not a socket";
+        return;
+      }
+      unlink(socketPath_.c_str());
+    }
+    listenFd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd_ < 0
+        || bind(listenFd_, (struct sockaddr*) &addr, sizeof(addr)) != 0
+        || listen(listenFd_, 4) != 0) {
+      error_ = socketPath_ + ": " + strerror(errno);
+      if (listenFd_ >= 0) {
+        close(listenFd_);
+        listenFd_ = -1;
+      }
+      return;
+    }
+  }
+  thread_ = thread(&MetricsExporter::run, this);
+}
+
+MetricsExporter::~MetricsExporter() {
+  if (!ok()) {
+    return;
+  }
+  stop_.store(true);
+  thread_.join();
+  if (!path_.empty()) {
+    writeFile();
+  }
+  if (listenFd_ >= 0) {
+    close(listenFd_);
+    unlink(socketPath_.c_str());
+  }
+}
+
+void MetricsExporter::writeFile() {
+  string tmp = path_ + ".tmp";
+  FILE* f = fopen(tmp.c_str(), "w");
+  if (!f) {
+    return;
+  }
+  string text = metrics_.format();
+  bool written = fwrite(text.data(), 1, text.size(), f) == text.size();
+  if (fclose(f) == 0 && written) {
+    rename(tmp.c_str(), path_.c_str());
+  } else {
+    unlink(tmp.c_str());
+  }
+}
+
+void MetricsExporter::serve(int fd) {
+  // Plain connections get the bare text; HTTP clients such as
+  // curl --unix-socket get a minimal response around it.
+  char request[1024];
+  int len = 0;
+  struct pollfd p = { fd, POLLIN, 0 };
+  if (poll(&p, 1, kPollMillis) > 0) {
+    len = max((int) recv(fd, request, sizeof(request), MSG_DONTWAIT), 0);
+  }
+  string text = metrics_.format();
+  if (len >= 4 && memcmp(request, "GET ", 4) == 0) {
+    ostringstream header;
+    header << "HTTP/1.0 200 OK\r\n"
+           << "Content-Type: text/plain; version=0.0.4\r\n"
+           << "Content-Length: " << text.size() << "\r\n\r\n";
+    text = header.str() + text;
+  }
+  size_t sent = 0;
+  while (sent < text.size()) {
+    ssize_t n = send(fd, text.data() + sent, text.size() - sent,
+                     MSG_NOSIGNAL);
+    if (n <= 0) {
+      break;
+    }
+    sent += n;
+  }
+}
+
+void MetricsExporter::run() {
+  int64_t nextWrite = monotonicNanos();
+  while (!stop_.load()) {
+    int64_t now = monotonicNanos();
+    if (!path_.empty() && now >= nextWrite) {
+      writeFile();
+      nextWrite = now + intervalNanos_;
+    }
+    int timeout = kPollMillis;
+    if (!path_.empty()) {
+      timeout = min<int64_t>(timeout, (nextWrite - now) / 1000000 + 1);
+    }
+    if (listenFd_ < 0) {
+      this_thread::sleep_for(chrono::milliseconds(timeout));
+      continue;
+    }
+    struct pollfd p = { listenFd_, POLLIN, 0 };
+    if (poll(&p, 1, timeout) > 0) {
+      int fd = accept(listenFd_, 0, 0);
+      if (fd >= 0) {
+        serve(fd);
+        close(fd);
+      }
+    }
+  }
+}
+
+}  // namespace radioreceiver
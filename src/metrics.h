@@ -0,0 +1,144 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * Export of the decoder's counters in the Prometheus text format.
+ */
+
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+#include <thread>
+
+#include "stats.h"
+
+using namespace std;
+
+namespace radioreceiver {
+
+/**
+ * The exported counters and gauges.
+ */
+enum {
+  METRIC_SAMPLES_IN = 0,
+  METRIC_SAMPLES_OUT = 1,
+  METRIC_BLOCKS = 2,
+  METRIC_CARRIER_BLOCKS = 3,
+  METRIC_STEREO_BLOCKS = 4,
+  METRIC_LATE_BLOCKS = 5,
+  METRIC_DROPPED_BLOCKS = 6,
+  METRIC_BACKLOG = 7,
+  NUM_METRICS = 8
+};
+
+/**
+ * The current values of the metrics. They are written by the decoding
+ * thread and read by the exporter without locks: each value is a relaxed
+ * atomic, so a scrape may mix values from consecutive blocks but never
+ * sees a torn one.
+ */
+class Metrics {
+  atomic<int64_t> values_[NUM_METRICS];
+  atomic<int64_t> stageNanos_[NUM_STAGES];
+  atomic<int64_t> stageSamples_[NUM_STAGES];
+
+ public:
+  Metrics();
+
+  /**
+   * Sets the value of a metric. Only one thread may write the metrics.
+   * @param metric One of the METRIC_* constants.
+   * @param value The new value.
+   */
+  void set(int metric, int64_t value) {
+    values_[metric].store(value, memory_order_relaxed);
+  }
+
+  /**
+   * Adds to the value of a counter. Only one thread may write the metrics.
+   * @param metric One of the METRIC_* constants.
+   * @param delta The amount to add.
+   */
+  void add(int metric, int64_t delta) {
+    set(metric, values_[metric].load(memory_order_relaxed) + delta);
+  }
+
+  /**
+   * Copies the accumulated stage figures.
+   * @param stats The figures, which must not have been reset since the
+   *     metrics were created so that the counters never go back.
+   */
+  void setStages(const StageStats& stats);
+
+  /**
+   * Returns the metrics in the Prometheus text exposition format.
+   */
+  string format() const;
+};
+
+/**
+ * Publishes the metrics from a background thread, periodically rewriting
+ * a textfile for node_exporter's textfile collector and/or answering each
+ * connection to a Unix domain socket with the current values.
+ */
+class MetricsExporter {
+  const Metrics& metrics_;
+  string path_;
+  string socketPath_;
+  int64_t intervalNanos_;
+  int listenFd_;
+  string error_;
+  atomic<bool> stop_;
+  thread thread_;
+
+  void run();
+  void writeFile();
+  void serve(int fd);
+
+ public:
+  /**
+   * Opens the socket and starts the exporter thread.
+   * @param metrics The metrics to publish.
+   * @param path The path of the textfile, or empty to not write one. It is
+   *     written to a temporary file which is then renamed so that readers
+   *     never see a partial file.
+   * @param socketPath The path of the Unix domain socket, or empty to not
+   *     open one.
+   * @param interval The time between rewrites of the textfile in seconds.
+   */
+  MetricsExporter(const Metrics& metrics, const string& path,
+                  const string& socketPath, double interval);
+
+  /**
+   * Writes the textfile a last time and removes the socket.
+   */
+  ~MetricsExporter();
+
+  /**
+   * Tells whether the exporter could be started.
+   */
+  bool ok() const { return error_.empty(); }
+
+  /**
+   * Returns the reason the exporter could not be started.
+   */
+  const string& error() const { return error_; }
+};
+
+}  // namespace radioreceiver
+
+#endif  // METRICS_H_
@@ -0,0 +1,113 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * Detection of a decoder that can't keep up with its live input.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <ostream>
+#include <stdint.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+
+#include "overrun.h"
+
+using namespace std;
+
+namespace radioreceiver {
+
+// The capacity of a pipe when it can't be queried.
+const int kDefaultPipeSize = 65536;
+
+OverrunMonitor::OverrunMonitor(int fd, int64_t threshold, int blockSize)
+    : fd_(fd), pollable_(false), capacity_(kDefaultPipeSize),
+      threshold_(threshold), behind_(false) {
+  memset(&counters_, 0, sizeof(counters_));
+  struct stat st;
+  if (fstat(fd, &st) == 0 && (S_ISFIFO(st.st_mode) || S_ISSOCK(st.st_mode))) {
+    pollable_ = true;
+#ifdef F_GETPIPE_SZ
+    int size = fcntl(fd, F_GETPIPE_SZ);
+    if (size > 0) {
+      capacity_ = size;
+    }
+#endif
+  }
+  if (threshold_ <= 0) {
+    threshold_ = min((int64_t) 4 * blockSize, (int64_t) capacity_ * 3 / 4);
+  }
+}
+
+bool OverrunMonitor::setPipeSize(int bytes) {
+#ifdef F_SETPIPE_SZ
+  if (pollable_) {
+    int size = fcntl(fd_, F_SETPIPE_SZ, bytes);
+    if (size > 0) {
+      capacity_ = size;
+      return true;
+    }
+  }
+#endif
+  return false;
+}
+
+int64_t OverrunMonitor::backlog() {
+  int bytes = 0;
+  if (!pollable_ || ioctl(fd_, FIONREAD, &bytes) != 0) {
+    return -1;
+  }
+  return bytes;
+}
+
+bool OverrunMonitor::update(int64_t processNanos, int64_t blockNanos) {
+  ++counters_.blocks;
+  if (processNanos > blockNanos) {
+    ++counters_.lateBlocks;
+  }
+  int64_t bytes = backlog();
+  if (bytes < 0) {
+    return behind_;
+  }
+  counters_.backlog = bytes;
+  counters_.maxBacklog = max(counters_.maxBacklog, bytes);
+  // Half the threshold as hysteresis so that a policy doesn't flap.
+  if (!behind_ && bytes > threshold_) {
+    behind_ = true;
+    ++counters_.episodes;
+  } else if (behind_ && bytes < threshold_ / 2) {
+    behind_ = false;
+  }
+  if (behind_) {
+    ++counters_.behindBlocks;
+  }
+  return behind_;
+}
+
+void OverrunMonitor::print(ostream& out) const {
+  out << "overrun: " << counters_.blocks << " blocks, "
+      << counters_.lateBlocks << " late, " << counters_.behindBlocks
+      << " behind in " << counters_.episodes << " episodes, "
+      << counters_.droppedBlocks << " dropped";
+  if (pollable_) {
+    out << "; backlog " << counters_.backlog << " bytes, max "
+        << counters_.maxBacklog << " of " << capacity_ << ", threshold "
+        << threshold_;
+  }
+  out << endl;
+}
+
+}  // namespace radioreceiver
@@ -0,0 +1,134 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * Detection of a decoder that can't keep up with its live input.
+ */
+
+#ifndef OVERRUN_H_
+#define OVERRUN_H_
+
+#include <ostream>
+#include <stdint.h>
+
+using namespace std;
+
+namespace radioreceiver {
+
+/**
+ * What to do when the decoder falls behind its input.
+ */
+enum {
+  OVERRUN_NONE = 0,
+  OVERRUN_REPORT = 1,
+  OVERRUN_DROP = 2,
+  OVERRUN_DEGRADE = 3
+};
+
+/**
+ * Counters describing how well the decoder kept up with its input.
+ */
+struct OverrunCounters {
+  /** Blocks read. */
+  int64_t blocks;
+  /** Blocks that took longer to process than their duration. */
+  int64_t lateBlocks;
+  /** Blocks read while the input backlog was over the threshold. */
+  int64_t behindBlocks;
+  /** Times the backlog went over the threshold. */
+  int64_t episodes;
+  /** Blocks discarded by the drop policy. */
+  int64_t droppedBlocks;
+  /** The largest input backlog seen, in bytes. */
+  int64_t maxBacklog;
+  /** The input backlog at the last measurement, in bytes. */
+  int64_t backlog;
+};
+
+/**
+ * Watches the amount of data waiting in the input pipe or socket and the
+ * time spent processing each block to tell when the decoder falls behind.
+ * The backlog can only be measured on pipes and sockets; on other inputs
+ * only late blocks are counted.
+ */
+class OverrunMonitor {
+  int fd_;
+  bool pollable_;
+  int capacity_;
+  int64_t threshold_;
+  bool behind_;
+  OverrunCounters counters_;
+
+ public:
+  /**
+   * Constructor for the monitor.
+   * @param fd The input file descriptor.
+   * @param threshold The backlog in bytes above which the decoder is
+   *     considered to be behind. If 0, four blocks or three quarters of the
+   *     pipe's capacity, whichever is less.
+   * @param blockSize The size of the blocks read from the input, in bytes.
+   */
+  OverrunMonitor(int fd, int64_t threshold, int blockSize);
+
+  /**
+   * Tries to change the capacity of the input pipe.
+   * @param bytes The requested capacity.
+   * @return Whether the capacity could be changed.
+   */
+  bool setPipeSize(int bytes);
+
+  /**
+   * Returns the number of bytes waiting to be read, or -1 if it can't be
+   * measured on this input.
+   */
+  int64_t backlog();
+
+  /**
+   * Updates the state after reading a block.
+   * @param processNanos The time it took to process the previous block.
+   * @param blockNanos The duration of the signal in the previous block.
+   * @return Whether the decoder is behind.
+   */
+  bool update(int64_t processNanos, int64_t blockNanos);
+
+  /**
+   * Accounts for a block discarded to catch up.
+   */
+  void dropped() { ++counters_.droppedBlocks; }
+
+  /**
+   * Tells whether the decoder is behind its input.
+   */
+  bool behind() const { return behind_; }
+
+  /**
+   * Returns the backlog threshold in bytes.
+   */
+  int64_t threshold() const { return threshold_; }
+
+  /**
+   * Returns the counters.
+   */
+  const OverrunCounters& counters() const { return counters_; }
+
+  /**
+   * Writes a human-readable summary of the counters.
+   * @param out The stream to write the summary to.
+   */
+  void print(ostream& out) const;
+};
+
+}  // namespace radioreceiver
+
+#endif  // OVERRUN_H_
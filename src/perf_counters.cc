@@ -0,0 +1,111 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * Hardware performance counters for the calling thread.
+ */
+
+#include <cerrno>
+#include <cstring>
+#include <stdint.h>
+#include <string>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "perf_counters.h"
+
+using namespace std;
+
+namespace radioreceiver {
+
+#ifdef __linux__
+
+static const uint64_t kEventConfigs[NUM_COUNTERS] = {
+  PERF_COUNT_HW_CPU_CYCLES,
+  PERF_COUNT_HW_INSTRUCTIONS,
+  PERF_COUNT_HW_CACHE_MISSES,
+  PERF_COUNT_HW_BRANCH_MISSES
+};
+
+PerfCounters::PerfCounters() {
+  for (int i = 0; i < NUM_COUNTERS; ++i) {
+    fds_[i] = -1;
+  }
+  for (int i = 0; i < NUM_COUNTERS; ++i) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = kEventConfigs[i];
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.disabled = i == 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    int fd = syscall(__NR_perf_event_open, &attr, 0, -1, fds_[0], 0);
+    if (fd < 0) {
+      error_ = strerror(errno);
+      for (int j = 0; j < i; ++j) {
+        close(fds_[j]);
+        fds_[j] = -1;
+      }
+      return;
+    }
+    fds_[i] = fd;
+  }
+  ioctl(fds_[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ioctl(fds_[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+PerfCounters::~PerfCounters() {
+  for (int i = NUM_COUNTERS - 1; i >= 0; --i) {
+    if (fds_[i] >= 0) {
+      close(fds_[i]);
+    }
+  }
+}
+
+void PerfCounters::read(uint64_t values[NUM_COUNTERS]) {
+  // With PERF_FORMAT_GROUP the leader returns the number of counters
+  // followed by their values.
+  uint64_t buffer[NUM_COUNTERS + 1];
+  if (!available()
+      || ::read(fds_[0], buffer, sizeof(buffer)) != sizeof(buffer)) {
+    memset(values, 0, NUM_COUNTERS * sizeof(uint64_t));
+    return;
+  }
+  memcpy(values, buffer + 1, NUM_COUNTERS * sizeof(uint64_t));
+}
+
+#else
+
+PerfCounters::PerfCounters() : error_("not supported on this platform") {
+  for (int i = 0; i < NUM_COUNTERS; ++i) {
+    fds_[i] = -1;
+  }
+}
+
+PerfCounters::~PerfCounters() {}
+
+void PerfCounters::read(uint64_t values[NUM_COUNTERS]) {
+  memset(values, 0, NUM_COUNTERS * sizeof(uint64_t));
+}
+
+#endif
+
+}  // namespace radioreceiver
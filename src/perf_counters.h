@@ -0,0 +1,76 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * Hardware performance counters for the calling thread.
+ */
+
+#ifndef PERF_COUNTERS_H_
+#define PERF_COUNTERS_H_
+
+#include <stdint.h>
+#include <string>
+
+using namespace std;
+
+namespace radioreceiver {
+
+/**
+ * The hardware events that are counted.
+ */
+enum {
+  COUNTER_CYCLES = 0,
+  COUNTER_INSTRUCTIONS = 1,
+  COUNTER_CACHE_MISSES = 2,
+  COUNTER_BRANCH_MISSES = 3,
+  NUM_COUNTERS = 4
+};
+
+/**
+ * A group of hardware performance counters opened with perf_event_open
+ * for the thread that constructs it. The counters only count in user
+ * space, so they work with the default perf_event_paranoid setting.
+ */
+class PerfCounters {
+  int fds_[NUM_COUNTERS];
+  string error_;
+
+ public:
+  /**
+   * Opens and starts the counters for the calling thread.
+   */
+  PerfCounters();
+  ~PerfCounters();
+
+  /**
+   * Tells whether the counters could be opened.
+   */
+  bool available() const { return fds_[0] >= 0; }
+
+  /**
+   * Returns the reason why the counters could not be opened.
+   */
+  const string& error() const { return error_; }
+
+  /**
+   * Reads the current values of all the counters.
+   * @param values The array to store the values in, indexed by the
+   *     COUNTER_* constants. Zeroed if the counters are not available.
+   */
+  void read(uint64_t values[NUM_COUNTERS]);
+};
+
+}  // namespace radioreceiver
+
+#endif  // PERF_COUNTERS_H_
@@ -0,0 +1,162 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * Decoder pipelines composed at compile time.
+ */
+
+#ifndef PIPELINE_H_
+#define PIPELINE_H_
+
+#include "dsp.h"
+#include "stats.h"
+
+using namespace std;
+
+namespace radioreceiver {
+
+/**
+ * A post-filter stage that leaves the audio as it is.
+ */
+class NoPostFilter {
+ public:
+  float filter(float sample) { return sample; }
+  float delay() const { return 0; }
+};
+
+/**
+ * Runs a post-filter over a block of audio, timed as a stage of its own.
+ */
+template <typename PostFilterStage>
+void applyPostFilter(PostFilterStage* filter, Samples* audio) {
+  StageTimer timer(STAGE_DEEMPHASIS, audio->size());
+  filter->inPlace(*audio);
+}
+
+/**
+ * Leaves the audio alone, without a stage in the statistics.
+ */
+inline void applyPostFilter(NoPostFilter*, Samples*) {}
+
+/**
+ * A demodulation chain whose stages are template parameters, so that the
+ * compiler generates code for each combination of stages with no virtual
+ * calls and every stage's per-sample work inlined into its pass.
+ *
+ * The front end (a FrontEnd) runs on whole blocks, because its squelch
+ * decides per block and other decoders may be fed from it. The rest of the
+ * chain runs in three loops, each timed as its own stage: the
+ * discriminator (an AMDetector or FMDiscriminator) writes its output
+ * straight into the resampler's (a Downsampler's) filter history, then
+ * each audio sample is resampled, and then the audio is passed through the
+ * post-filter (a Deemphasizer or NoPostFilter). Interleaving the first two
+ * loops sample by sample turned out to be slower.
+ */
+template <typename FrontEndStage, typename DiscriminatorStage,
+          typename ResamplerStage, typename PostFilterStage>
+class Pipeline {
+  FrontEndStage frontEnd_;
+  DiscriminatorStage discriminator_;
+  ResamplerStage resampler_;
+  PostFilterStage postFilter_;
+  const float* demodulated_;
+  int demodulatedLength_;
+  bool squelched_;
+
+ public:
+  /**
+   * Constructor from the stages.
+   */
+  Pipeline(const FrontEndStage& frontEnd,
+           const DiscriminatorStage& discriminator,
+           const ResamplerStage& resampler, const PostFilterStage& postFilter)
+      : frontEnd_(frontEnd), discriminator_(discriminator),
+        resampler_(resampler), postFilter_(postFilter), demodulated_(0),
+        demodulatedLength_(0), squelched_(false) {}
+
+  /**
+   * Demodulates, resamples and filters a block of a channel.
+   * @param channel The channel's I/Q samples, from frontEnd() or a front
+   *     end shared with other decoders.
+   * @param squelched Whether the front end's squelch silenced the block.
+   * @return The audio.
+   */
+  Samples process(const SamplesIQ& channel, bool squelched) {
+    int length = channel.I.size();
+    squelched_ = squelched;
+    if (squelched) {
+      discriminator_.reset();
+      demodulated_ = 0;
+      demodulatedLength_ = 0;
+      // The post-filter holds its state until the squelch opens.
+      return resampler_.silence(length);
+    }
+    const float* I = channel.I.data();
+    const float* Q = channel.Q.data();
+    float* demodulated = resampler_.prepare(length);
+    {
+      StageTimer timer(STAGE_DISCRIMINATOR, length);
+      // Works on a copy of the discriminator, whose state the compiler can
+      // then keep in registers instead of storing it after every sample.
+      DiscriminatorStage discriminator(discriminator_);
+      discriminator.begin();
+      for (int i = 0; i < length; ++i) {
+        demodulated[i] = discriminator.demodulate(I[i], Q[i]);
+      }
+      discriminator.end(demodulated, length);
+      discriminator_ = discriminator;
+    }
+    Samples out(resampler_.outputLength(length));
+    {
+      StageTimer timer(STAGE_RESAMPLER, length);
+      for (int j = 0; j < out.size(); ++j) {
+        out[j] = resampler_.get(resampler_.position(j));
+      }
+      resampler_.finish(length);
+    }
+    applyPostFilter(&postFilter_, &out);
+    demodulated_ = demodulated;
+    demodulatedLength_ = length;
+    return out;
+  }
+
+  /**
+   * Returns the discriminator's output for the last block, which stays
+   * valid until the next one. Empty if the block was squelched.
+   */
+  const float* demodulated() const { return demodulated_; }
+
+  /**
+   * Returns the length of the discriminator's output for the last block.
+   */
+  int demodulatedLength() const { return demodulatedLength_; }
+
+  /**
+   * Tells whether the squelch silenced the last block.
+   */
+  bool squelched() const { return squelched_; }
+
+  FrontEndStage& frontEnd() { return frontEnd_; }
+  const FrontEndStage& frontEnd() const { return frontEnd_; }
+  DiscriminatorStage& discriminator() { return discriminator_; }
+  const DiscriminatorStage& discriminator() const { return discriminator_; }
+  ResamplerStage& resampler() { return resampler_; }
+  const ResamplerStage& resampler() const { return resampler_; }
+  PostFilterStage& postFilter() { return postFilter_; }
+  const PostFilterStage& postFilter() const { return postFilter_; }
+};
+
+}  // namespace radioreceiver
+
+#endif  // PIPELINE_H_
@@ -0,0 +1,331 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * Synthetic I/Q test signal generation.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <stdint.h>
+#include <vector>
+
+#include "hdlc.h"
+#include "siggen.h"
+
+using namespace std;
+
+namespace radioreceiver {
+
+const double kPi = 3.141592653589793238;
+const double k2Pi = 2 * kPi;
+const double kPhaseScale = 4294967296.0;
+
+SignalSpec defaultSignalSpec(int modulation, int sampleRate) {
+  SignalSpec spec;
+  spec.modulation = modulation;
+  spec.sampleRate = sampleRate;
+  spec.amplitude = 0.5;
+  spec.toneFreq = 1000;
+  spec.rightToneFreq = 2500;
+  spec.depth = 0.5;
+  spec.maxF = modulation == SIGNAL_WBFM ? 75000
+      : modulation == SIGNAL_FSK ? 3000 : 5000;
+  spec.baudRate = 9600;
+  spec.freqOffset = 0;
+  spec.freqDrift = 0;
+  spec.snr = 60;
+  spec.seed = 1;
+  spec.scramble = false;
+  spec.hdlc = false;
+  spec.dcOffset = 0;
+  spec.iqGain = 1;
+  spec.iqPhase = 0;
+  return spec;
+}
+
+/**
+ * Returns the phase accumulator step for the given frequency.
+ */
+static uint32_t phaseStep(double freq, int sampleRate) {
+  return (uint32_t) (int64_t) llround(freq / sampleRate * kPhaseScale);
+}
+
+SignalGenerator::SignalGenerator(const SignalSpec& spec)
+    : spec_(spec),
+      sinTable_(1 << kTableBits),
+      noiseTable_(1 << kNoiseTableBits),
+      noiseAmpl_(spec.amplitude / sqrt(2 * pow(10, spec.snr / 10))),
+      carrierPhase_(0),
+      carrierStep_(phaseStep(spec.freqOffset, spec.sampleRate)),
+      tonePhase_(0),
+      toneStep_(phaseStep(spec.toneFreq, spec.sampleRate)),
+      rightPhase_(0),
+      rightStep_(phaseStep(spec.rightToneFreq, spec.sampleRate)),
+      pilotPhase_(0),
+      pilotStep_(phaseStep(19000, spec.sampleRate)),
+      devScale_(kPhaseScale / spec.sampleRate),
+      prbs_((spec.seed & 0x7fff) | 1),
+      scrambler_(0),
+      frameBit_(0),
+      frameCount_(0),
+      nrziLevel_(0),
+      symbolPhase_(0),
+      symbolStep_(phaseStep(spec.baudRate, spec.sampleRate)),
+      symbol_(1),
+      shaped_(0),
+      shapeMult_(1 - exp(-k2Pi * 0.75 * spec.baudRate / spec.sampleRate)),
+      generated_(0) {
+  for (int i = 0; i < (1 << kTableBits); ++i) {
+    sinTable_[i] = sin(k2Pi * i / (1 << kTableBits));
+  }
+  for (int i = 0; i < kNoiseLanes; ++i) {
+    rng_[i] = (spec.seed + i) * 2654435761u + 1;
+  }
+  uint32_t state = spec.seed;
+  for (int i = 0; i < (1 << kNoiseTableBits); i += 2) {
+    state = state * 1664525 + 1013904223;
+    double u1 = ((state >> 8) + 1) / 16777217.0;
+    state = state * 1664525 + 1013904223;
+    double u2 = (state >> 8) / 16777216.0;
+    double r = sqrt(-2 * log(u1));
+    noiseTable_[i] = r * cos(k2Pi * u2);
+    noiseTable_[i + 1] = r * sin(k2Pi * u2);
+  }
+}
+
+inline float SignalGenerator::sinOf(uint32_t phase) const {
+  return sinTable_[phase >> (32 - kTableBits)];
+}
+
+inline float SignalGenerator::cosOf(uint32_t phase) const {
+  return sinTable_[(phase + 0x40000000u) >> (32 - kTableBits)];
+}
+
+/**
+ * Simulates a tuner whose Q branch has a gain and phase error relative to
+ * its I branch, and which adds a DC offset to both.
+ */
+void SignalGenerator::addImpairments(float* out, int numSamples) {
+  float phase = spec_.iqPhase * kPi / 180;
+  float qFromQ = spec_.iqGain * cos(phase);
+  float qFromI = spec_.iqGain * sin(phase);
+  for (int i = 0; i < numSamples; ++i) {
+    float I = out[2 * i];
+    float Q = out[2 * i + 1];
+    out[2 * i] = I + spec_.dcOffset;
+    out[2 * i + 1] = Q * qFromQ + I * qFromI + spec_.dcOffset;
+  }
+}
+
+/**
+ * Adds Gaussian noise to the given values. Several independent xorshift
+ * generators are interleaved so that they don't serialize the loop.
+ */
+void SignalGenerator::addNoise(float* out, int length) {
+  const float* table = noiseTable_.data();
+  for (int i = 0; i < length; i += kNoiseLanes) {
+    for (int l = 0; l < kNoiseLanes; ++l) {
+      uint32_t r = rng_[l];
+      r ^= r << 13;
+      r ^= r >> 17;
+      r ^= r << 5;
+      rng_[l] = r;
+      if (i + l < length) {
+        out[i + l] += noiseAmpl_ * table[r >> (32 - kNoiseTableBits)];
+      }
+    }
+  }
+}
+
+/**
+ * Appends the bits of the next HDLC frame, NRZI encoded, to frameBits_.
+ */
+void SignalGenerator::makeFrame() {
+  const char* dest = "CQ    ";
+  const char* src = "DEMOD ";
+  vector<uint8_t> frame;
+  for (int i = 0; i < 6; ++i) {
+    frame.push_back(dest[i] << 1);
+  }
+  frame.push_back(0xe0);
+  for (int i = 0; i < 6; ++i) {
+    frame.push_back(src[i] << 1);
+  }
+  frame.push_back(0x61);
+  frame.push_back(0x03);
+  frame.push_back(0xf0);
+  char seq[16];
+  snprintf(seq, sizeof(seq), "seq %05d", frameCount_++ % 100000);
+  frame.insert(frame.end(), seq, seq + 9);
+  for (int i = 0; i < 32; ++i) {
+    frame.push_back(prbs_ & 0xff);
+    for (int b = 0; b < 8; ++b) {
+      int bit = ((prbs_ >> 14) ^ (prbs_ >> 13)) & 1;
+      prbs_ = ((prbs_ << 1) | bit) & 0x7fff;
+    }
+  }
+  uint16_t fcs = crc16X25(frame.data(), frame.size());
+  frame.push_back(fcs & 0xff);
+  frame.push_back(fcs >> 8);
+
+  vector<uint8_t> bits;
+  for (int f = 0; f < 4; ++f) {
+    for (int b = 0; b < 8; ++b) {
+      bits.push_back((0x7e >> b) & 1);
+    }
+  }
+  int ones = 0;
+  for (uint8_t byte : frame) {
+    for (int b = 0; b < 8; ++b) {
+      int bit = (byte >> b) & 1;
+      bits.push_back(bit);
+      ones = bit ? ones + 1 : 0;
+      if (ones == 5) {
+        bits.push_back(0);
+        ones = 0;
+      }
+    }
+  }
+  frameBits_.clear();
+  frameBit_ = 0;
+  for (int bit : bits) {
+    if (!bit) {
+      nrziLevel_ ^= 1;
+    }
+    frameBits_.push_back(nrziLevel_);
+  }
+}
+
+/**
+ * Returns the next data bit: from a PRBS-15 (x^15 + x^14 + 1) sequence,
+ * or from HDLC frames, scrambled if the specification asks for it.
+ */
+inline int SignalGenerator::nextBit() {
+  int bit;
+  if (spec_.hdlc) {
+    if (frameBit_ == frameBits_.size()) {
+      makeFrame();
+    }
+    bit = frameBits_[frameBit_++];
+  } else {
+    bit = ((prbs_ >> 14) ^ (prbs_ >> 13)) & 1;
+    prbs_ = ((prbs_ << 1) | bit) & 0x7fff;
+  }
+  if (spec_.scramble) {
+    bit ^= ((scrambler_ >> 11) ^ (scrambler_ >> 16)) & 1;
+    scrambler_ = (scrambler_ << 1) | bit;
+  }
+  return bit;
+}
+
+void SignalGenerator::generate(float* out, int numSamples) {
+  if (spec_.freqDrift == 0) {
+    generateChunk(out, numSamples);
+    return;
+  }
+  // The carrier's frequency is updated every millisecond.
+  int chunk = spec_.sampleRate / 1000;
+  for (int pos = 0; pos < numSamples; pos += chunk) {
+    double time = (double) generated_ / spec_.sampleRate;
+    carrierStep_ = phaseStep(spec_.freqOffset + spec_.freqDrift * time,
+                             spec_.sampleRate);
+    int len = min(chunk, numSamples - pos);
+    generateChunk(out + 2 * pos, len);
+    generated_ += len;
+  }
+}
+
+void SignalGenerator::generateChunk(float* out, int numSamples) {
+  float ampl = spec_.amplitude;
+  float dev = spec_.maxF * devScale_;
+  switch (spec_.modulation) {
+  case SIGNAL_AM:
+    for (int i = 0; i < numSamples; ++i) {
+      float env = ampl * (1 + spec_.depth * sinOf(tonePhase_));
+      out[2 * i] = env * cosOf(carrierPhase_);
+      out[2 * i + 1] = env * sinOf(carrierPhase_);
+      tonePhase_ += toneStep_;
+      carrierPhase_ += carrierStep_;
+    }
+    break;
+  case SIGNAL_NBFM:
+    for (int i = 0; i < numSamples; ++i) {
+      out[2 * i] = ampl * cosOf(carrierPhase_);
+      out[2 * i + 1] = ampl * sinOf(carrierPhase_);
+      carrierPhase_ += carrierStep_ + (int32_t) (dev * sinOf(tonePhase_));
+      tonePhase_ += toneStep_;
+    }
+    break;
+  case SIGNAL_FSK:
+    for (int i = 0; i < numSamples; ++i) {
+      out[2 * i] = ampl * cosOf(carrierPhase_);
+      out[2 * i + 1] = ampl * sinOf(carrierPhase_);
+      uint32_t next = symbolPhase_ + symbolStep_;
+      if (next < symbolPhase_) {
+        symbol_ = nextBit() ? 1 : -1;
+      }
+      symbolPhase_ = next;
+      shaped_ += (symbol_ - shaped_) * shapeMult_;
+      carrierPhase_ += carrierStep_ + (int32_t) (dev * shaped_);
+    }
+    break;
+  case SIGNAL_WBFM:
+    for (int i = 0; i < numSamples; ++i) {
+      out[2 * i] = ampl * cosOf(carrierPhase_);
+      out[2 * i + 1] = ampl * sinOf(carrierPhase_);
+      float left = sinOf(tonePhase_);
+      float right = sinOf(rightPhase_);
+      float composite = 0.45f * (left + right)
+          + 0.45f * (left - right) * sinOf(2 * pilotPhase_)
+          + 0.1f * sinOf(pilotPhase_);
+      carrierPhase_ += carrierStep_ + (int32_t) (dev * composite);
+      tonePhase_ += toneStep_;
+      rightPhase_ += rightStep_;
+      pilotPhase_ += pilotStep_;
+    }
+    break;
+  }
+  if (spec_.snr < 200) {
+    addNoise(out, 2 * numSamples);
+  }
+  if (spec_.dcOffset != 0 || spec_.iqGain != 1 || spec_.iqPhase != 0) {
+    addImpairments(out, numSamples);
+  }
+}
+
+Samples SignalGenerator::generate(int numSamples) {
+  Samples out(2 * numSamples);
+  generate(out.data(), numSamples);
+  return out;
+}
+
+void samplesToUint8(const float* samples, int length, uint8_t* out) {
+  for (int i = 0; i < length; ++i) {
+    float val = samples[i] * 128 + 128;
+    val = val < 0 ? 0 : val > 255 ? 255 : val;
+    out[i] = (uint8_t) (val + 0.5f);
+  }
+}
+
+void samplesToInt16(const float* samples, int length, int16_t* out) {
+  for (int i = 0; i < length; ++i) {
+    float val = samples[i] * 32768;
+    val = val < -32768 ? -32768 : val > 32767 ? 32767 : val;
+    out[i] = (int16_t) lrintf(val);
+  }
+}
+
+}  // namespace radioreceiver
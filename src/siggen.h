@@ -0,0 +1,182 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * Synthetic I/Q test signal generation.
+ */
+
+#ifndef SIGGEN_H_
+#define SIGGEN_H_
+
+#include <stdint.h>
+#include <vector>
+
+#include "dsp.h"
+
+using namespace std;
+
+namespace radioreceiver {
+
+enum {
+  SIGNAL_AM = 0,
+  SIGNAL_NBFM = 1,
+  SIGNAL_FSK = 2,
+  SIGNAL_WBFM = 3
+};
+
+/**
+ * The parameters of a synthetic signal.
+ */
+struct SignalSpec {
+  /** One of the SIGNAL_* constants. */
+  int modulation;
+  /** The sample rate of the generated I/Q stream. */
+  int sampleRate;
+  /** The carrier amplitude, between 0 and 1. */
+  float amplitude;
+  /** The modulating tone's frequency; the left channel's tone in WBFM. */
+  float toneFreq;
+  /** The right channel's tone frequency in WBFM. */
+  float rightToneFreq;
+  /** The AM modulation depth, between 0 and 1. */
+  float depth;
+  /** The FM frequency deviation at full modulation. */
+  float maxF;
+  /** The symbol rate for FSK. */
+  int baudRate;
+  /** The carrier's offset from the center frequency, in Hz. */
+  float freqOffset;
+  /** The rate at which the carrier's offset changes, in Hz per second. */
+  float freqDrift;
+  /**
+   * The carrier to noise ratio over the whole sample bandwidth, in dB.
+   * Values of 200 or more disable the noise.
+   */
+  float snr;
+  /** The seed for the noise and FSK data generators. */
+  uint32_t seed;
+  /** Whether to scramble the FSK data with the G3RUH (x^17 + x^12 + 1)
+      scrambler. */
+  bool scramble;
+  /**
+   * Whether the FSK data is NRZI encoded HDLC frames instead of a PRBS.
+   * Each frame is an AX.25 UI frame from DEMOD to CQ whose information
+   * field is "seq " followed by the frame number as five decimal digits
+   * and 32 pseudo-random bytes, and is preceded by four flags.
+   */
+  bool hdlc;
+  /** The DC offset the tuner adds to both I and Q, in full-scale units. */
+  float dcOffset;
+  /** The gain of the tuner's Q branch relative to its I branch. */
+  float iqGain;
+  /** The phase error of the tuner's Q branch, in degrees. */
+  float iqPhase;
+};
+
+/**
+ * Returns a signal specification with sensible defaults for the given
+ * modulation and sample rate.
+ * @param modulation One of the SIGNAL_* constants.
+ * @param sampleRate The sample rate of the generated stream.
+ * @return The signal specification.
+ */
+SignalSpec defaultSignalSpec(int modulation, int sampleRate);
+
+/**
+ * Generates a continuous synthetic I/Q stream. All oscillators are table
+ * driven phase accumulators so that the generator is much faster than
+ * any of the decoders.
+ */
+class SignalGenerator {
+  static const int kTableBits = 14;
+  static const int kNoiseTableBits = 12;
+  static const int kNoiseLanes = 4;
+
+  SignalSpec spec_;
+  vector<float> sinTable_;
+  vector<float> noiseTable_;
+  float noiseAmpl_;
+  uint32_t carrierPhase_;
+  uint32_t carrierStep_;
+  uint32_t tonePhase_;
+  uint32_t toneStep_;
+  uint32_t rightPhase_;
+  uint32_t rightStep_;
+  uint32_t pilotPhase_;
+  uint32_t pilotStep_;
+  float devScale_;
+  uint32_t rng_[kNoiseLanes];
+  uint32_t prbs_;
+  uint32_t scrambler_;
+  vector<uint8_t> frameBits_;
+  int frameBit_;
+  int frameCount_;
+  int nrziLevel_;
+  uint32_t symbolPhase_;
+  uint32_t symbolStep_;
+  float symbol_;
+  float shaped_;
+  float shapeMult_;
+  int64_t generated_;
+
+  float sinOf(uint32_t phase) const;
+  float cosOf(uint32_t phase) const;
+  void addNoise(float* out, int length);
+  void addImpairments(float* out, int numSamples);
+  int nextBit();
+  void makeFrame();
+  void generateChunk(float* out, int numSamples);
+
+ public:
+  /**
+   * Constructor for the generator.
+   * @param spec The signal's specification.
+   */
+  SignalGenerator(const SignalSpec& spec);
+
+  /**
+   * Generates the next I/Q samples of the stream.
+   * @param out The buffer to store the interleaved I/Q values in. Must
+   *     hold 2 * numSamples values.
+   * @param numSamples The number of complex samples to generate.
+   */
+  void generate(float* out, int numSamples);
+
+  /**
+   * Generates the next I/Q samples of the stream.
+   * @param numSamples The number of complex samples to generate.
+   * @return The interleaved I/Q samples.
+   */
+  Samples generate(int numSamples);
+};
+
+/**
+ * Converts I/Q values in the [-1, 1] range into unsigned 8-bit samples.
+ * @param samples The values to convert.
+ * @param length The number of values.
+ * @param out The buffer to store the converted values in.
+ */
+void samplesToUint8(const float* samples, int length, uint8_t* out);
+
+/**
+ * Converts I/Q values in the [-1, 1] range into signed 16-bit samples.
+ * @param samples The values to convert.
+ * @param length The number of values.
+ * @param out The buffer to store the converted values in.
+ */
+void samplesToInt16(const float* samples, int length, int16_t* out);
+
+}  // namespace radioreceiver
+
+#endif  // SIGGEN_H_
@@ -0,0 +1,178 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * Per-stage timing instrumentation for the decoding pipeline.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <ostream>
+#include <stdint.h>
+
+#include "stats.h"
+#include "trace.h"
+
+using namespace std;
+
+namespace radioreceiver {
+
+const char* kStageNames[] = {
+  "convert", "frontend", "discriminator", "pilot_pll", "resampler",
+  "deemphasis", "output"
+};
+
+const char* stageName(int stage) {
+  return kStageNames[stage];
+}
+
+thread_local StageStats* StageStats::current_ = 0;
+
+StageStats::StageStats() : perf_(0), trace_(0), block_(0) {
+  reset();
+}
+
+void StageStats::addEvents(int stage, const uint64_t start[NUM_COUNTERS]) {
+  uint64_t now[NUM_COUNTERS];
+  perf_->read(now);
+  for (int i = 0; i < NUM_COUNTERS; ++i) {
+    counters_[stage].events[i] += now[i] - start[i];
+  }
+}
+
+void StageStats::addSpan(int stage, int64_t startNanos, int64_t endNanos,
+                         int samples) {
+  trace_->record(stageName(stage), startNanos, endNanos, block_, samples);
+}
+
+void StageStats::reset() {
+  memset(counters_, 0, sizeof(counters_));
+}
+
+void StageStats::setCurrent(StageStats* stats) {
+  current_ = stats;
+}
+
+void StageStats::printEvents(ostream& out) const {
+  // Cycles per input sample add up across the stages, so they show what
+  // each stage costs relative to the incoming I/Q stream.
+  int64_t inSamples = counters_[STAGE_CONVERT].samples;
+  out << left << setw(14) << "stage" << right << setw(12) << "cyc/sample"
+      << setw(12) << "cyc/input" << setw(8) << "IPC" << setw(14)
+      << "cache-miss/k" << setw(14) << "branch-miss/k" << endl;
+  out << fixed;
+  for (int i = 0; i < NUM_STAGES; ++i) {
+    const StageCounters& c = counters_[i];
+    if (c.calls == 0) {
+      continue;
+    }
+    double cycles = c.events[COUNTER_CYCLES];
+    double perKSample = c.samples ? 1000.0 / c.samples : 0;
+    out << left << setw(14) << stageName(i) << right << setprecision(2)
+        << setw(12) << (c.samples ? cycles / c.samples : 0)
+        << setw(12) << (inSamples ? cycles / inSamples : 0)
+        << setw(8) << (cycles ? c.events[COUNTER_INSTRUCTIONS] / cycles : 0)
+        << setw(14) << c.events[COUNTER_CACHE_MISSES] * perKSample
+        << setw(14) << c.events[COUNTER_BRANCH_MISSES] * perKSample << endl;
+  }
+}
+
+void StageStats::print(ostream& out, double signalSeconds) const {
+  int64_t total = 0;
+  for (int i = 0; i < NUM_STAGES; ++i) {
+    total += counters_[i].nanos;
+  }
+  out << left << setw(14) << "stage" << right << setw(10) << "calls"
+      << setw(14) << "samples" << setw(12) << "time_ms" << setw(12)
+      << "ns/sample" << setw(12) << "Msamples/s" << setw(8) << "share"
+      << endl;
+  out << fixed;
+  for (int i = 0; i < NUM_STAGES; ++i) {
+    const StageCounters& c = counters_[i];
+    if (c.calls == 0) {
+      continue;
+    }
+    double nsPerSample = c.samples ? (double) c.nanos / c.samples : 0;
+    out << left << setw(14) << stageName(i) << right << setw(10) << c.calls
+        << setw(14) << c.samples << setw(12) << setprecision(1)
+        << c.nanos / 1e6 << setw(12) << setprecision(2) << nsPerSample
+        << setw(12) << (c.nanos ? 1e3 * c.samples / c.nanos : 0)
+        << setw(7) << setprecision(1)
+        << (total ? 100.0 * c.nanos / total : 0) << "%" << endl;
+  }
+  if (perf_) {
+    printEvents(out);
+  }
+  out << "total " << setprecision(1) << total / 1e6 << " ms for "
+      << setprecision(2) << signalSeconds << " s of signal";
+  if (total) {
+    out << ", " << setprecision(1) << signalSeconds * 1e9 / total
+        << "x real time";
+  }
+  out << endl;
+  out.unsetf(ios::floatfield);
+}
+
+LatencyHistogram::LatencyHistogram() {
+  reset();
+}
+
+void LatencyHistogram::reset() {
+  memset(buckets_, 0, sizeof(buckets_));
+  count_ = 0;
+  max_ = 0;
+}
+
+int LatencyHistogram::bucketOf(int64_t nanos) {
+  if (nanos < (1 << kSubBits)) {
+    return nanos < 0 ? 0 : nanos;
+  }
+  int exp = 63 - __builtin_clzll(nanos);
+  int sub = (nanos >> (exp - kSubBits)) & ((1 << kSubBits) - 1);
+  return ((exp - kSubBits + 1) << kSubBits) + sub;
+}
+
+int64_t LatencyHistogram::bucketValue(int bucket) {
+  if (bucket < (1 << kSubBits)) {
+    return bucket;
+  }
+  int exp = (bucket >> kSubBits) + kSubBits - 1;
+  int64_t sub = bucket & ((1 << kSubBits) - 1);
+  // Upper edge of the bucket, so that percentiles are never understated.
+  return (((int64_t) 1 << kSubBits) + sub + 1) << (exp - kSubBits);
+}
+
+void LatencyHistogram::add(int64_t nanos) {
+  ++buckets_[bucketOf(nanos)];
+  ++count_;
+  if (nanos > max_) {
+    max_ = nanos;
+  }
+}
+
+int64_t LatencyHistogram::percentile(double fraction) const {
+  int64_t target = (int64_t) ceil(fraction * count_);
+  int64_t seen = 0;
+  for (int i = 0; i < kNumBuckets; ++i) {
+    seen += buckets_[i];
+    if (seen >= target && seen > 0) {
+      return min(bucketValue(i), max_);
+    }
+  }
+  return max_;
+}
+
+}  // namespace radioreceiver
@@ -0,0 +1,285 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * Per-stage timing instrumentation for the decoding pipeline.
+ */
+
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <ostream>
+#include <stdint.h>
+#include <time.h>
+
+#include "perf_counters.h"
+
+using namespace std;
+
+namespace radioreceiver {
+
+class TraceWriter;
+
+/**
+ * The instrumented stages of the decoding pipeline.
+ */
+enum Stage {
+  STAGE_CONVERT = 0,
+  STAGE_FRONTEND = 1,
+  STAGE_DISCRIMINATOR = 2,
+  STAGE_PILOT_PLL = 3,
+  STAGE_RESAMPLER = 4,
+  STAGE_DEEMPHASIS = 5,
+  STAGE_OUTPUT = 6,
+  NUM_STAGES = 7
+};
+
+/**
+ * Returns the name of the given stage.
+ * @param stage One of the STAGE_* constants.
+ * @return The stage's name.
+ */
+const char* stageName(int stage);
+
+/**
+ * Returns the current value of the monotonic clock in nanoseconds.
+ */
+inline int64_t monotonicNanos() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * The accumulated figures for one stage.
+ */
+struct StageCounters {
+  int64_t nanos;
+  int64_t samples;
+  int64_t calls;
+  /** The hardware events counted, indexed by the COUNTER_* constants. */
+  uint64_t events[NUM_COUNTERS];
+};
+
+/**
+ * Accumulates the time spent and the samples processed in each stage.
+ * The decoders report to the instance that is current on their thread,
+ * so nothing is measured unless one has been installed with setCurrent().
+ */
+class StageStats {
+  StageCounters counters_[NUM_STAGES];
+  PerfCounters* perf_;
+  TraceWriter* trace_;
+  int64_t block_;
+
+ public:
+  StageStats();
+
+  /**
+   * Attributes hardware events to the stages too. The counters must belong
+   * to the thread the stages run on.
+   * @param perf The counters to read, or null to only measure time.
+   */
+  void setPerfCounters(PerfCounters* perf) { perf_ = perf; }
+
+  /**
+   * Returns the hardware counters in use, or null if there are none.
+   */
+  PerfCounters* perfCounters() const { return perf_; }
+
+  /**
+   * Records every stage execution as a span in a trace too.
+   * @param trace The trace to record to, or null to only accumulate the
+   *     figures.
+   */
+  void setTrace(TraceWriter* trace) { trace_ = trace; }
+
+  /**
+   * Returns the trace in use, or null if there is none.
+   */
+  TraceWriter* trace() const { return trace_; }
+
+  /**
+   * Sets the number of the block being processed, which is attached to
+   * the spans in the trace.
+   * @param block The block number.
+   */
+  void setBlock(int64_t block) { block_ = block; }
+
+  /**
+   * Returns the number of the block being processed.
+   */
+  int64_t block() const { return block_; }
+
+  /**
+   * Adds a stage execution to the figures.
+   * @param stage One of the STAGE_* constants.
+   * @param nanos The time the stage took.
+   * @param samples The number of samples the stage consumed.
+   */
+  void add(int stage, int64_t nanos, int64_t samples) {
+    counters_[stage].nanos += nanos;
+    counters_[stage].samples += samples;
+    ++counters_[stage].calls;
+  }
+
+  /**
+   * Adds the hardware events counted since the given counter values to
+   * the figures.
+   * @param stage One of the STAGE_* constants.
+   * @param start The counter values when the stage started.
+   */
+  void addEvents(int stage, const uint64_t start[NUM_COUNTERS]);
+
+  /**
+   * Records a stage execution in the trace.
+   * @param stage One of the STAGE_* constants.
+   * @param startNanos The time the stage started on the monotonic clock.
+   * @param endNanos The time the stage ended on the monotonic clock.
+   * @param samples The number of samples the stage consumed.
+   */
+  void addSpan(int stage, int64_t startNanos, int64_t endNanos, int samples);
+
+  /**
+   * Returns the figures for the given stage.
+   * @param stage One of the STAGE_* constants.
+   */
+  const StageCounters& get(int stage) const { return counters_[stage]; }
+
+  /**
+   * Clears all the figures.
+   */
+  void reset();
+
+  /**
+   * Writes a human-readable report of the figures.
+   * @param out The stream to write the report to.
+   * @param signalSeconds The duration of the input signal processed while
+   *     the figures were accumulated, used to compute the real-time factor.
+   */
+  void print(ostream& out, double signalSeconds) const;
+
+  /**
+   * Sets the instance the stages running on this thread report to.
+   * @param stats The instance, or null to disable the instrumentation.
+   */
+  static void setCurrent(StageStats* stats);
+
+  /**
+   * Returns the instance the stages running on this thread report to,
+   * or null if the instrumentation is disabled.
+   */
+  static StageStats* current() { return current_; }
+
+ private:
+  static thread_local StageStats* current_;
+
+  void printEvents(ostream& out) const;
+};
+
+/**
+ * Measures the time, and the hardware events if the StageStats has
+ * counters, until it goes out of scope and adds them to the given stage of
+ * the thread's current StageStats, recording a span if it has a trace.
+ * When there is no current instance it costs a thread-local load and a
+ * branch.
+ */
+class StageTimer {
+  StageStats* stats_;
+  int stage_;
+  int samples_;
+  int64_t start_;
+  uint64_t events_[NUM_COUNTERS];
+
+ public:
+  /**
+   * Starts measuring a stage execution.
+   * @param stage One of the STAGE_* constants.
+   * @param samples The number of samples the stage consumes.
+   */
+  StageTimer(int stage, int samples)
+      : stats_(StageStats::current()), stage_(stage), samples_(samples) {
+    if (stats_) {
+      if (stats_->perfCounters()) {
+        stats_->perfCounters()->read(events_);
+      }
+      start_ = monotonicNanos();
+    }
+  }
+
+  ~StageTimer() {
+    if (stats_) {
+      int64_t end = monotonicNanos();
+      if (stats_->perfCounters()) {
+        stats_->addEvents(stage_, events_);
+      }
+      stats_->add(stage_, end - start_, samples_);
+      if (stats_->trace()) {
+        stats_->addSpan(stage_, start_, end, samples_);
+      }
+    }
+  }
+};
+
+/**
+ * A histogram of durations with logarithmic buckets, each spanning about
+ * 6% of its value, for reporting latency percentiles.
+ */
+class LatencyHistogram {
+  static const int kSubBits = 4;
+  static const int kNumBuckets = 64 << kSubBits;
+
+  int64_t buckets_[kNumBuckets];
+  int64_t count_;
+  int64_t max_;
+
+  static int bucketOf(int64_t nanos);
+  static int64_t bucketValue(int bucket);
+
+ public:
+  LatencyHistogram();
+
+  /**
+   * Adds a duration to the histogram.
+   * @param nanos The duration in nanoseconds.
+   */
+  void add(int64_t nanos);
+
+  /**
+   * Returns the duration below which the given fraction of the durations
+   * fall.
+   * @param fraction The fraction, between 0 and 1.
+   * @return The duration in nanoseconds.
+   */
+  int64_t percentile(double fraction) const;
+
+  /**
+   * Returns the number of durations added.
+   */
+  int64_t count() const { return count_; }
+
+  /**
+   * Returns the longest duration added, in nanoseconds.
+   */
+  int64_t max() const { return max_; }
+
+  /**
+   * Clears the histogram.
+   */
+  void reset();
+};
+
+}  // namespace radioreceiver
+
+#endif  // STATS_H_
@@ -0,0 +1,126 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * Export of pipeline execution spans in the Chrome trace event format,
+ * which Perfetto and chrome://tracing can load.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#include "stats.h"
+#include "trace.h"
+
+using namespace std;
+
+namespace radioreceiver {
+
+// How long the writer thread sleeps when the buffer is empty.
+const int kWriterSleepMillis = 20;
+
+int32_t currentThreadId() {
+  static thread_local int32_t id = 0;
+  if (id == 0) {
+#ifdef SYS_gettid
+    id = syscall(SYS_gettid);
+#else
+    id = getpid();
+#endif
+  }
+  return id;
+}
+
+TraceWriter::TraceWriter(const string& path, int capacity)
+    : head_(0), tail_(0), stop_(false), dropped_(0),
+      origin_(monotonicNanos()), first_(true) {
+  uint64_t size = 1;
+  while (size < (uint64_t) capacity) {
+    size <<= 1;
+  }
+  ring_.resize(size);
+  mask_ = size - 1;
+  out_ = fopen(path.c_str(), "w");
+  if (!out_) {
+    return;
+  }
+  fprintf(out_, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  fprintf(out_, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+          "\"args\":{\"name\":\"demod\"}}", (int) getpid());
+  first_ = false;
+  thread_ = thread(&TraceWriter::run, this);
+}
+
+TraceWriter::~TraceWriter() {
+  if (!out_) {
+    return;
+  }
+  stop_.store(true);
+  thread_.join();
+  drain();
+  fprintf(out_, "\n]}\n");
+  fclose(out_);
+}
+
+void TraceWriter::record(const TraceEvent& event) {
+  uint64_t head = head_.load(memory_order_relaxed);
+  if (head - tail_.load(memory_order_acquire) > mask_) {
+    dropped_.fetch_add(1, memory_order_relaxed);
+    return;
+  }
+  ring_[head & mask_] = event;
+  head_.store(head + 1, memory_order_release);
+}
+
+void TraceWriter::record(const char* name, int64_t beginNanos,
+                         int64_t endNanos, int64_t block, int samples) {
+  TraceEvent event = { name, beginNanos, endNanos, block, samples,
+                       currentThreadId() };
+  record(event);
+}
+
+void TraceWriter::drain() {
+  uint64_t tail = tail_.load(memory_order_relaxed);
+  uint64_t head = head_.load(memory_order_acquire);
+  int pid = getpid();
+  for (; tail != head; ++tail) {
+    const TraceEvent& e = ring_[tail & mask_];
+    // Complete events with microsecond timestamps relative to the start.
+    fprintf(out_, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,"
+            "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"block\":%lld,"
+            "\"samples\":%d}}",
+            e.name, pid, (int) e.threadId, (e.beginNanos - origin_) / 1e3,
+            (e.endNanos - e.beginNanos) / 1e3, (long long) e.block,
+            (int) e.samples);
+  }
+  tail_.store(tail, memory_order_release);
+}
+
+void TraceWriter::run() {
+  while (!stop_.load()) {
+    drain();
+    this_thread::sleep_for(chrono::milliseconds(kWriterSleepMillis));
+  }
+}
+
+}  // namespace radioreceiver
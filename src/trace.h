@@ -0,0 +1,118 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * Export of pipeline execution spans in the Chrome trace event format,
+ * which Perfetto and chrome://tracing can load.
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <atomic>
+#include <cstdio>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace radioreceiver {
+
+/**
+ * A span of time spent in a pipeline stage.
+ */
+struct TraceEvent {
+  /** The span's name. Must be a string literal or otherwise outlive the
+      writer. */
+  const char* name;
+  int64_t beginNanos;
+  int64_t endNanos;
+  int64_t block;
+  int32_t samples;
+  int32_t threadId;
+};
+
+/**
+ * Writes trace events to a file from a background thread. Events are
+ * passed through a single-producer single-consumer ring buffer, so only
+ * one thread may record events; events recorded while the buffer is full
+ * are counted and dropped rather than blocking the producer.
+ */
+class TraceWriter {
+  vector<TraceEvent> ring_;
+  uint64_t mask_;
+  atomic<uint64_t> head_;
+  atomic<uint64_t> tail_;
+  atomic<bool> stop_;
+  atomic<int64_t> dropped_;
+  int64_t origin_;
+  FILE* out_;
+  bool first_;
+  thread thread_;
+
+  void run();
+  void drain();
+
+ public:
+  /**
+   * Creates the trace file and starts the writer thread.
+   * @param path The path of the file to write.
+   * @param capacity The number of events the buffer holds. Rounded up to a
+   *     power of two.
+   */
+  TraceWriter(const string& path, int capacity = 65536);
+
+  /**
+   * Writes the remaining events and closes the file.
+   */
+  ~TraceWriter();
+
+  /**
+   * Tells whether the trace file could be created.
+   */
+  bool ok() const { return out_ != 0; }
+
+  /**
+   * Queues an event for writing. Never blocks.
+   * @param event The event to write.
+   */
+  void record(const TraceEvent& event);
+
+  /**
+   * Queues an event for a span on the calling thread.
+   * @param name The span's name.
+   * @param beginNanos The span's start on the monotonic clock.
+   * @param endNanos The span's end on the monotonic clock.
+   * @param block The number of the block the span worked on.
+   * @param samples The number of samples the span consumed.
+   */
+  void record(const char* name, int64_t beginNanos, int64_t endNanos,
+              int64_t block, int samples);
+
+  /**
+   * Returns the number of events dropped because the buffer was full.
+   */
+  int64_t dropped() const { return dropped_.load(); }
+};
+
+/**
+ * Returns the operating system's identifier for the calling thread.
+ */
+int32_t currentThreadId();
+
+}  // namespace radioreceiver
+
+#endif  // TRACE_H_
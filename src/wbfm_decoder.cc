@@ -17,49 +17,195 @@
  * audio signals, and sends them back.
  */
 
+#include <algorithm>
 #include <memory>
 #include <vector>
 
 #include "dsp.h"
+#include "stats.h"
 #include "wbfm_decoder.h"
 
 using namespace std;
 
 namespace radioreceiver {
 
-WBFMDecoder::WBFMDecoder(int inRate, int outRate)
-    : demodulator_(inRate, kInterRate, kMaxF, kMaxF * 0.9, 101),
-      filterCoefs_(getLowPassFIRCoeffs(kInterRate, kFilterFreq, kFilterLen)),
-      monoSampler_(kInterRate, outRate, filterCoefs_),
-      stereoSampler_(kInterRate, outRate, filterCoefs_),
-      stereoSeparator_(kInterRate, kPilotFreq),
-      leftDeemph_(outRate, kDeemphTc),
-      rightDeemph_(outRate, kDeemphTc) {}
+// The stopband attenuation and passband ripple of the filters, in dB.
+const float kAttenuation = 70;
+const float kRipple = 0.1;
+
+WBFMDecoder::WBFMDecoder(int inRate, int outRate, int channelRate)
+    : inRate_(inRate),
+      channelRate_(channelRate),
+      minimumPhase_(false),
+      outRate_(outRate),
+      filterCoefs_(getEquirippleFIRCoeffs(channelRate, kFilterPass,
+                                          kFilterStop, kAttenuation, kRipple)),
+      pipeline_(FrontEnd(inRate, channelRate,
+                         getEquirippleFIRCoeffs(inRate, kMaxF * 3 / 5,
+                                                kMaxF * 5 / 4, kAttenuation,
+                                                kRipple)),
+                FMDiscriminator(channelRate, kMaxF),
+                Downsampler(channelRate, outRate, filterCoefs_),
+                Deemphasizer(outRate, kDeemphTc)),
+      stereoSampler_(channelRate, outRate, filterCoefs_),
+      stereoSeparator_(channelRate, kPilotFreq),
+      diffDeemph_(outRate, kDeemphTc) {}
 
 StereoAudio WBFMDecoder::decode(const Samples& samples, bool inStereo) {
-  Samples demodulated(demodulator_.demodulateTuned(samples));
+  FrontEnd& frontEnd = pipeline_.frontEnd();
+  SamplesIQ channel(frontEnd.process(samples));
+  return decodeChannel(channel, frontEnd.squelched(), inStereo);
+}
 
+FrontEnd* WBFMDecoder::frontEnd() {
+  return &pipeline_.frontEnd();
+}
+
+StereoAudio WBFMDecoder::decodeChannel(const SamplesIQ& channel,
+                                       bool squelched, bool inStereo) {
+  // The pipeline deemphasizes the mono signal, and the stereo difference
+  // is deemphasized on its own before being added to it and subtracted
+  // from it, which is the same as deemphasizing each channel.
   StereoAudio output;
   output.inStereo = false;
-  output.left = monoSampler_.downsample(demodulated);
+  output.left = pipeline_.process(channel, squelched);
   output.right = output.left;
-  output.carrier = demodulator_.hasCarrier();
+  output.carrier = pipeline_.discriminator().hasCarrier();
+  if (squelched) {
+    // The stereo samplers skip the block too, so that their output stays
+    // as long as the mono output, and their filters' history is cleared.
+    stereoSampler_.silence(channel.I.size());
+    for (auto& extra : extras_) {
+      extra->audio.left = extra->monoSampler.silence(channel.I.size());
+      extra->audio.right = extra->audio.left;
+      extra->audio.inStereo = false;
+      extra->audio.carrier = false;
+      extra->stereoSampler.silence(channel.I.size());
+    }
+    return output;
+  }
+  Samples demodulated;
+  if (inStereo || !extras_.empty()) {
+    demodulated.assign(pipeline_.demodulated(),
+                       pipeline_.demodulated() + pipeline_.demodulatedLength());
+  }
+  {
+    StageTimer timer(STAGE_RESAMPLER, demodulated.size());
+    for (auto& extra : extras_) {
+      extra->audio.left = extra->monoSampler.downsample(demodulated);
+      extra->audio.right = extra->audio.left;
+      extra->audio.inStereo = false;
+      extra->audio.carrier = output.carrier;
+    }
+  }
 
+  StereoSignal stereo{false, Samples()};
   if (inStereo) {
-    StereoSignal stereo(stereoSeparator_.separate(demodulated));
-    if (stereo.hasPilot) {
-      Samples diffAudio(stereoSampler_.downsample(stereo.diff));
-      for (int i = 0; i < diffAudio.size(); ++i) {
-        output.right[i] -= 2 * diffAudio[i];
-        output.left[i] += 2 * diffAudio[i];
-      }
-      output.inStereo = true;
+    StageTimer timer(STAGE_PILOT_PLL, demodulated.size());
+    stereo = stereoSeparator_.separate(demodulated);
+  }
+  Samples diffAudio;
+  if (stereo.hasPilot) {
+    StageTimer timer(STAGE_RESAMPLER, stereo.diff.size());
+    diffAudio = stereoSampler_.downsample(stereo.diff);
+    output.inStereo = true;
+    for (auto& extra : extras_) {
+      addStereo(stereo.diff, &extra->stereoSampler, &extra->audio);
+    }
+  } else {
+    // Keeps the stereo samplers in step with the mono ones.
+    stereoSampler_.silence(channel.I.size());
+    for (auto& extra : extras_) {
+      extra->stereoSampler.silence(channel.I.size());
+    }
+  }
+  {
+    // Without a pilot, the difference left over from the last stereo block
+    // still has to decay.
+    StageTimer timer(STAGE_DEEMPHASIS, output.left.size());
+    for (int i = 0; i < output.left.size(); ++i) {
+      float in = i < diffAudio.size() ? 2 * diffAudio[i] : 0;
+      float diff = diffDeemph_.filter(in);
+      output.left[i] += diff;
+      output.right[i] -= diff;
     }
   }
 
-  leftDeemph_.inPlace(output.left);
-  rightDeemph_.inPlace(output.right);
+  for (auto& extra : extras_) {
+    StageTimer timer(STAGE_DEEMPHASIS, 2 * extra->audio.left.size());
+    extra->leftDeemph.inPlace(extra->audio.left);
+    extra->rightDeemph.inPlace(extra->audio.right);
+  }
   return output;
 }
 
+void WBFMDecoder::addStereo(const Samples& diff, Downsampler* sampler,
+                            StereoAudio* audio) {
+  Samples diffAudio;
+  {
+    StageTimer timer(STAGE_RESAMPLER, diff.size());
+    diffAudio = sampler->downsample(diff);
+  }
+  int length = min(diffAudio.size(), audio->left.size());
+  for (int i = 0; i < length; ++i) {
+    audio->right[i] -= 2 * diffAudio[i];
+    audio->left[i] += 2 * diffAudio[i];
+  }
+  audio->inStereo = true;
+}
+
+double WBFMDecoder::groupDelay() {
+  return pipeline_.frontEnd().delay() / inRate_
+      + pipeline_.resampler().delay() / channelRate_
+      + pipeline_.postFilter().delay() / outRate_;
+}
+
+void WBFMDecoder::setSquelch(float level, float hysteresis) {
+  pipeline_.frontEnd().setSquelch(level, hysteresis);
+}
+
+void WBFMDecoder::setMinimumPhase() {
+  if (minimumPhase_) {
+    return;
+  }
+  minimumPhase_ = true;
+  // The front end keeps its linear phase: its kernel is short at the input
+  // rate anyway, and a delay that varies across the wide FM channel
+  // distorts the demodulated audio and the stereo subcarrier.
+  pipeline_.resampler().makeMinimumPhase();
+  stereoSampler_.makeMinimumPhase();
+  for (auto& extra : extras_) {
+    extra->monoSampler.makeMinimumPhase();
+    extra->stereoSampler.makeMinimumPhase();
+  }
+}
+
+bool WBFMDecoder::squelched() {
+  return pipeline_.squelched();
+}
+
+int WBFMDecoder::addOutput(int outRate) {
+  // Keeps the passband below the new rate's Nyquist frequency, and the
+  // aliases of the transition band out of the passband.
+  float passFreq = min<float>(kFilterPass, 0.3 * outRate);
+  float stopFreq = min<float>(kFilterStop, outRate - passFreq);
+  vector<float> coefs(getEquirippleFIRCoeffs(channelRate_, passFreq, stopFreq,
+                                             kAttenuation, kRipple));
+  extras_.emplace_back(new ExtraOutput{
+      Downsampler(channelRate_, outRate, coefs),
+      Downsampler(channelRate_, outRate, coefs),
+      Deemphasizer(outRate, kDeemphTc),
+      Deemphasizer(outRate, kDeemphTc),
+      StereoAudio{Samples(), Samples(), false, false}});
+  if (minimumPhase_) {
+    extras_.back()->monoSampler.makeMinimumPhase();
+    extras_.back()->stereoSampler.makeMinimumPhase();
+  }
+  return extras_.size() - 1;
+}
+
+StereoAudio WBFMDecoder::extraOutput(int index) {
+  return extras_[index]->audio;
+}
+
 }  // namespace radioreceiver
@@ -26,6 +26,7 @@
 
 #include "decoder.h"
 #include "dsp.h"
+#include "pipeline.h"
 
 using namespace std;
 
@@ -39,16 +40,33 @@ class WBFMDecoder : public Decoder {
   static const int kMaxF = 75000;
   static const int kPilotFreq = 19000;
   static const int kDeemphTc = 50;
-  static const int kFilterFreq = 10000;
-  static const int kFilterLen = 41;
+  static const int kFilterPass = 1000;
+  static const int kFilterStop = 30000;
 
-  FMDemodulator demodulator_;
+  int inRate_;
+  int channelRate_;
+  bool minimumPhase_;
+  int outRate_;
   vector<float> filterCoefs_;
-  Downsampler monoSampler_;
+  Pipeline<FrontEnd, FMDiscriminator, Downsampler, Deemphasizer> pipeline_;
   Downsampler stereoSampler_;
   StereoSeparator stereoSeparator_;
-  Deemphasizer leftDeemph_;
-  Deemphasizer rightDeemph_;
+  Deemphasizer diffDeemph_;
+
+  /**
+   * The back-end of an output added with addOutput().
+   */
+  struct ExtraOutput {
+    Downsampler monoSampler;
+    Downsampler stereoSampler;
+    Deemphasizer leftDeemph;
+    Deemphasizer rightDeemph;
+    StereoAudio audio;
+  };
+  vector<unique_ptr<ExtraOutput> > extras_;
+
+  void addStereo(const Samples& diff, Downsampler* sampler,
+                 StereoAudio* audio);
 
  public:
   /**
@@ -56,8 +74,10 @@ class WBFMDecoder : public Decoder {
    * @param inRate The sample rate for the input sample stream.
    * @param outRate The sample rate for the output stereo audio stream.
    *     The recommended rate is 48000.
+   * @param channelRate The sample rate of the channel after the front
+   *     end, when it is shared with other decoders.
    */
-  WBFMDecoder(int inRate, int outRate);
+  WBFMDecoder(int inRate, int outRate, int channelRate = kInterRate);
 
   /**
    * Demodulates a block of floating-point samples, producing a block of
@@ -67,6 +87,23 @@ class WBFMDecoder : public Decoder {
    * @return The generated stereo audio block.
    */
   virtual StereoAudio decode(const Samples& samples, bool inStereo);
+
+  virtual FrontEnd* frontEnd();
+
+  virtual StereoAudio decodeChannel(const SamplesIQ& channel, bool squelched,
+                                    bool inStereo);
+
+  virtual double groupDelay();
+
+  virtual void setSquelch(float level, float hysteresis);
+
+  virtual void setMinimumPhase();
+
+  virtual bool squelched();
+
+  virtual int addOutput(int outRate);
+
+  virtual StereoAudio extraOutput(int index);
 };
 
 }  // namespace radioreceiver